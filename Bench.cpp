@@ -0,0 +1,494 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Bench - benchmark suite(see Benchmark.hpp) for the kernels of every program and for whole shapes, so a change in speed
+shows up as a number. Microbenchmarks time one call of eval, evalBlock, numericalPartialDiff, partialDiff, evalInterval,
+blackBirdN, calcArea, greens(PA3), chenLai, findLL, modifiedGraham, convexHull and quickHull and one call of a native
+kernel(NativeKernel.hpp, built in $GREENS_NATIVE or /tmp/greens-native; it runs last so the other benchmarks stay on the
+interpreter), end-to-end benchmarks compute the fixed corpus: the parabola/line of Hyades, the 4/x - 1/x cycle of
+MidnightOil, the ellipse of Cygnus and the same ellipse found without a start point by the quadtree of ZeroSet.hpp.
+Rates are reported as evals/s(evaluations of f, df/dx or df/dy) and points/s(boundary points found, or points
+ordered/summed). The end-to-end benchmarks count their evaluations with the counters of Instrument.hpp, so they report
+evals/s only in a build with -DGREENS_INSTRUMENT(which also adds the cost of counting to their times).
+The Hyades kernels come from the greens library. Pleiades, MidnightOil and Cygnus are whole programs, so each one is
+compiled into its own namespace with its main renamed; every header they include is included here first, so their
+#includes add nothing inside the namespace.
+Build: c++ -O2 -pthread Bench.cpp -o Bench
+Run:   ./Bench [--filter=text] [--min_time=seconds] [--format=csv]*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include "exprtk.hpp"
+#include "PolygonArea.h"
+#include "ExpressionTree.hpp"
+#include "ConvexHull.hpp"
+#include "PointFile.h"
+#include "Manifest.hpp"
+#include "Daemon.hpp"
+#include "ResultCache.hpp"
+#include "Scheduler.hpp"
+#include "Greens.hpp"
+#include "Instrument.hpp"
+#include "TraceSink.hpp"
+#include "NativeKernel.hpp"
+#include "Interval.hpp"
+#include "ZeroSet.hpp"
+#include "Benchmark.hpp"
+
+#define main pleiadesMain
+namespace pleiades {
+#include "Pleiades.cpp"
+}
+#undef main
+#define main midnightOilMain
+namespace midnightOil {
+#include "MidnightOil.cpp"
+}
+#undef main
+#define main cygnusMain
+namespace cygnus {
+#include "Cygnus.cpp"
+}
+#undef main
+
+using namespace std;
+
+const string ELLIPSE = "(x*x)+(x*y)+(y*y)-4";//Boundary of the Cygnus ellipse, also used by the microbenchmarks
+const size_t POLYGON_SIZE = 1 << 16;//Number of vertices of the polygons the area kernels sum
+const size_t CLOUD_SIZE = 1 << 16;//Number of points the ordering kernels order
+
+/**********************Function Declarations**********************************/
+vector<greensPoint> circlePolygon(size_t);//Function to build a regular polygon inscribed in the unit circle
+vector<pleiades::point> randomCloud(size_t);//Function to build random points in the unit disk
+greensSegment greensBox(const string &, double, double, double, double);//Function to build a Hyades segment
+void addEvaluations(benchmarkState &, const instrumentCounters &);//Function to report the evaluations counted by a run
+void BM_eval(benchmarkState &);
+void BM_evalBlock(benchmarkState &);
+void BM_numericalPartialDiff(benchmarkState &);
+void BM_partialDiff(benchmarkState &);
+void BM_evalInterval(benchmarkState &);
+void BM_blackBirdN(benchmarkState &);
+void BM_calcArea(benchmarkState &);
+void BM_greens(benchmarkState &);
+void BM_chenLai(benchmarkState &);
+void BM_findLL(benchmarkState &);
+void BM_modifiedGraham(benchmarkState &);
+void BM_convexHull(benchmarkState &);
+void BM_quickHullCollinear(benchmarkState &);
+void BM_HyadesParabola(benchmarkState &);
+void BM_MidnightOilCycle(benchmarkState &);
+void BM_CygnusEllipse(benchmarkState &);
+void BM_zeroSetEllipse(benchmarkState &);
+void BM_nativeGradient(benchmarkState &);
+
+//Function to build a regular polygon with n vertices inscribed in the unit circle, counterclockwise
+vector<greensPoint> circlePolygon(size_t n)
+{
+    vector<greensPoint> polygon(n);
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        polygon[i].x = cos(2.0 * M_PI * i / n);
+        polygon[i].y = sin(2.0 * M_PI * i / n);
+    }
+    return polygon;
+}
+
+//Function to build n random points in the unit disk, the same points every run
+vector<pleiades::point> randomCloud(size_t n)
+{
+    mt19937_64 random(12345);
+    uniform_real_distribution<double> angle(0.0, 2.0 * M_PI), radius(0.0, 1.0);
+    vector<pleiades::point> cloud(n);
+    size_t i;
+    for(i = 0; i < n; i++)
+    {
+        double r = sqrt(radius(random)), t = angle(random);
+        cloud[i].x = r * cos(t);
+        cloud[i].y = r * sin(t);
+    }
+    return cloud;
+}
+
+//Function to build a Hyades segment that searches the box xmin..xmax, ymin..ymax, start and end are set by the caller
+greensSegment greensBox(const string &function, double xmin, double xmax, double ymin, double ymax)
+{
+    greensSegment segment;
+    segment.function = function;
+    segment.xmin = xmin;
+    segment.xmax = xmax;
+    segment.ymin = ymin;
+    segment.ymax = ymax;
+    segment.start.x = segment.start.y = segment.end.x = segment.end.y = 0.0;
+    return segment;
+}
+
+//Function to report the evaluations counted during a run as evals/s, there are none unless built with -DGREENS_INSTRUMENT
+void addEvaluations(benchmarkState &state, const instrumentCounters &counters)
+{
+    if(counters.counts[INSTRUMENT_EVALUATIONS] > 0)
+        state.addCounter("evals", (double)counters.counts[INSTRUMENT_EVALUATIONS]);
+}
+
+//One evaluation of the compiled expression
+void BM_eval(benchmarkState &state)
+{
+    greensContext context;
+    size_t i = 0;
+    eval(context, ELLIPSE, 0.0, 0.0);//Compile outside the timed loop
+    while(state.keepRunning())
+    {
+        doNotOptimize(eval(context, ELLIPSE, 0.001 * (i & 1023), 2.0));
+        i++;
+    }
+    state.addCounter("evals", state.iterations());
+}
+
+//One block of GREENS_BLOCK_SIZE evaluations in one pass over the expression tree(evalTreeBlock)
+void BM_evalBlock(benchmarkState &state)
+{
+    greensContext context;
+    double xs[GREENS_BLOCK_SIZE], ys[GREENS_BLOCK_SIZE], fs[GREENS_BLOCK_SIZE];
+    int j;
+    for(j = 0; j < GREENS_BLOCK_SIZE; j++)
+    {
+        xs[j] = 0.1 * j;
+        ys[j] = 2.0 - 0.1 * j;
+    }
+    evalBlock(context, ELLIPSE, xs, ys, fs, GREENS_BLOCK_SIZE);
+    while(state.keepRunning())
+    {
+        evalBlock(context, ELLIPSE, xs, ys, fs, GREENS_BLOCK_SIZE);
+        doNotOptimize(fs[0]);
+    }
+    state.addCounter("evals", (double)state.iterations() * GREENS_BLOCK_SIZE);
+}
+
+//Central difference gradient, a 5 point stencil of scalar evaluations
+void BM_numericalPartialDiff(benchmarkState &state)
+{
+    greensContext context;
+    double partials[3];
+    size_t i = 0;
+    numericalPartialDiff(context, ELLIPSE, 0.0, 2.0, partials);
+    while(state.keepRunning())
+    {
+        numericalPartialDiff(context, ELLIPSE, 0.001 * (i & 1023), 2.0, partials);
+        doNotOptimize(partials[0]);
+        i++;
+    }
+    state.addCounter("evals", 5.0 * state.iterations());
+}
+
+//Gradient by the fastest method the function allows, symbolic for the ellipse(f, df/dx and df/dy)
+void BM_partialDiff(benchmarkState &state)
+{
+    greensContext context;
+    double partials[3];
+    size_t i = 0;
+    greensCompile(context, ELLIPSE);
+    while(state.keepRunning())
+    {
+        partialDiff(context, ELLIPSE, 0.001 * (i & 1023), 2.0, partials);
+        doNotOptimize(partials[0]);
+        i++;
+    }
+    state.addCounter("evals", 3.0 * state.iterations());
+}
+
+//Enclosure of the ellipse over one small box(Interval.hpp), the test a zero-set search makes for every cell
+void BM_evalInterval(benchmarkState &state)
+{
+    exprTree tree;
+    parseTree(ELLIPSE, tree);
+    size_t i = 0;
+    while(state.keepRunning())
+    {
+        double x0 = 0.001 * (i & 1023);
+        doNotOptimize(boxMayHoldZero(tree, x0, x0 + 0.01, 1.9, 1.91));
+        i++;
+    }
+    state.addCounter("boxes", state.iterations());
+}
+
+//One step of the Blackbird search: gradient, 8 distances and 8 visited lookups
+void BM_blackBirdN(benchmarkState &state)
+{
+    greensContext context;
+    greensSegment segment = greensBox(ELLIPSE, -4.0, 4.0, -4.0, 4.0);
+    greensCompile(context, ELLIPSE);
+    initVisited(context, vector<greensSegment>(1, segment));
+    greensPoint current, next;
+    current.x = 0.0;
+    current.y = 2.0;
+    markVisited(context, current, true);
+    while(state.keepRunning())
+    {
+        blackBirdN(context, current, segment, next);
+        doNotOptimize(next.x);
+    }
+    state.addCounter("evals", 3.0 * state.iterations());
+}
+
+//Shoelace sum of the Hyades boundary polygon
+void BM_calcArea(benchmarkState &state)
+{
+    vector<greensPoint> polygon = circlePolygon(POLYGON_SIZE);
+    while(state.keepRunning())
+        doNotOptimize(calcArea(polygon));
+    state.addCounter("points", (double)state.iterations() * POLYGON_SIZE);
+}
+
+//Green's theorem sum of PA3 over interleaved x,y coordinates
+void BM_greens(benchmarkState &state)
+{
+    vector<greensPoint> polygon = circlePolygon(POLYGON_SIZE);
+    const double *v = &polygon[0].x;
+    while(state.keepRunning())
+        doNotOptimize(polygonArea(v, v + 1, POLYGON_SIZE, 2));//What PA3's greens computes
+    state.addCounter("points", (double)state.iterations() * POLYGON_SIZE);
+}
+
+//Area of the ordered Pleiades polygon
+void BM_chenLai(benchmarkState &state)
+{
+    vector<greensPoint> circle = circlePolygon(POLYGON_SIZE);
+    vector<pleiades::point> polygon(POLYGON_SIZE);
+    size_t i;
+    for(i = 0; i < POLYGON_SIZE; i++)
+    {
+        polygon[i].x = circle[i].x;
+        polygon[i].y = circle[i].y;
+    }
+    while(state.keepRunning())
+        doNotOptimize(pleiades::chenLai(polygon));
+    state.addCounter("points", (double)state.iterations() * POLYGON_SIZE);
+}
+
+//Search for the lower left point of a point cloud
+void BM_findLL(benchmarkState &state)
+{
+    vector<pleiades::point> cloud = randomCloud(CLOUD_SIZE);
+    while(state.keepRunning())
+        doNotOptimize(pleiades::findLL(cloud));
+    state.addCounter("points", (double)state.iterations() * CLOUD_SIZE);
+}
+
+//Ordering of a point cloud by angle around its lower left point, the input is restored untimed
+void BM_modifiedGraham(benchmarkState &state)
+{
+    vector<pleiades::point> cloud = randomCloud(CLOUD_SIZE), points;
+    while(state.keepRunning())
+    {
+        state.pauseTiming();
+        points = cloud;
+        state.resumeTiming();
+        pleiades::modifiedGraham(points);
+        doNotOptimize(points[0].x);
+    }
+    state.addCounter("points", (double)state.iterations() * CLOUD_SIZE);
+}
+
+//Convex hull of a point cloud, what Pleiades gives chenLai by default
+void BM_convexHull(benchmarkState &state)
+{
+    vector<pleiades::point> cloud = randomCloud(CLOUD_SIZE);
+    while(state.keepRunning())
+        doNotOptimize(convexHull(cloud, HULL_AUTO, 1).size());
+    state.addCounter("points", (double)state.iterations() * CLOUD_SIZE);
+}
+
+/*Parallel Quickhull of a shuffled lattice whose top and bottom rows are hull edges parallel to the line between the
+leftmost and rightmost points, every point of those rows is equally far from it(Check.cpp checks the hull itself)*/
+void BM_quickHullCollinear(benchmarkState &state)
+{
+    vector<pleiades::point> cloud;
+    pleiades::point p;
+    int i, j;
+    for(j = 0; j < 256; j++)
+    {
+        for(i = 1; i < 255; i++)
+        {
+            p.x = i;
+            p.y = j;
+            cloud.push_back(p);
+        }
+    }
+    p.y = 127.5;
+    p.x = 0.0;
+    cloud.push_back(p);
+    p.x = 255.0;
+    cloud.push_back(p);
+    mt19937_64 random(12345);
+    shuffle(cloud.begin(), cloud.end(), random);
+    while(state.keepRunning())
+        doNotOptimize(convexHull(cloud, HULL_QUICKHULL, 4).size());
+    state.addCounter("points", (double)state.iterations() * cloud.size());
+}
+
+//Hyades: region between y = x^2 and y = 2x, traced by the greens library
+void BM_HyadesParabola(benchmarkState &state)
+{
+    greensContext context;
+    vector<greensSegment> segments;
+    segments.push_back(greensBox("y-x*x", 0.0, 2.0, 0.0, 4.0));
+    segments.push_back(greensBox("y-2*x", 0.0, 2.0, 0.0, 4.0));
+    segments[0].end.x = segments[1].start.x = 2.0;
+    segments[0].end.y = segments[1].start.y = 4.0;
+    double area, points = 0.0;
+    greensShape(context, segments, area);//Compile outside the timed loop
+    instrumentCounters counters;
+    {
+        instrumentScope scope(&counters);
+        while(state.keepRunning())
+        {
+            greensShape(context, segments, area);
+            doNotOptimize(area);
+            points += context.area.count;
+        }
+    }
+    state.addCounter("points", points);
+    addEvaluations(state, counters);
+}
+
+//MidnightOil: cycle between x = 1, y = 4/x, x = 2 and y = 1/x
+void BM_MidnightOilCycle(benchmarkState &state)
+{
+    const char *functions[] = {"constantx", "4/x", "constantx", "1/x"};
+    double corners[][2] = {{1.0, 1.0}, {1.0, 4.0}, {2.0, 2.0}, {2.0, 0.5}};
+    vector<midnightOil::functionStruct> segments(4);
+    int k;
+    for(k = 0; k < 4; k++)
+    {
+        segments[k].function = functions[k];
+        segments[k].start.x = corners[k][0];
+        segments[k].start.y = corners[k][1];
+        segments[k].end.x = corners[(k + 1) % 4][0];
+        segments[k].end.y = corners[(k + 1) % 4][1];
+    }
+    double points = 0.0;
+    instrumentCounters counters;
+    {
+        instrumentScope scope(&counters);
+        while(state.keepRunning())
+        {
+            vector<midnightOil::point> orderedPoints;
+            for(k = 0; k < 4; k++)
+                midnightOil::dfs(segments[k], orderedPoints);
+            doNotOptimize(midnightOil::calcArea(orderedPoints));
+            points += orderedPoints.size();
+        }
+    }
+    state.addCounter("points", points);
+    addEvaluations(state, counters);
+}
+
+//Cygnus: ellipse x^2 + xy + y^2 = 4 as one closed loop
+void BM_CygnusEllipse(benchmarkState &state)
+{
+    cygnus::cygnusContext context;
+    cygnus::functionStruct segment;
+    segment.function = ELLIPSE;
+    segment.start = segment.end = make_pair(0.0, 2.0);
+    vector<pair<double,double>> orderedPoints;
+    string error;
+    double points = 0.0;
+    instrumentCounters counters;
+    {
+        instrumentScope scope(&counters);
+        while(state.keepRunning())
+        {
+            cygnus::traceSegment(context, segment, orderedPoints, error);
+            doNotOptimize(cygnus::calcArea(orderedPoints));
+            points += orderedPoints.size();
+        }
+    }
+    state.addCounter("points", points);
+    addEvaluations(state, counters);
+}
+
+//Ellipse as a region: every boundary point found by the quadtree of ZeroSet.hpp, leaves of the Hyades step size
+void BM_zeroSetEllipse(benchmarkState &state)
+{
+    greensContext context;
+    zeroSetEvaluator evaluate = [&context](const double *xs, const double *ys, double *values, int n) {
+        evalBlock(context, ELLIPSE, xs, ys, values, n);
+    };
+    zeroSetResult result;
+    double points = 0.0;
+    greensCompile(context, ELLIPSE);//Compile outside the timed loop
+    instrumentCounters counters;
+    {
+        instrumentScope scope(&counters);
+        while(state.keepRunning())
+        {
+            zeroSetExtract(ELLIPSE, evaluate, -3.0, 3.0, -3.0, 3.0, context.delta, result);
+            doNotOptimize(result.area);
+            points += result.points;
+        }
+    }
+    state.addCounter("points", points);
+    addEvaluations(state, counters);
+}
+
+/*Value and gradient from the native kernel of the ellipse, the counterpart of BM_partialDiff. Turns native kernels on for
+the rest of the run, so it is registered last. Falls back to partialDiff if the kernel cannot be built*/
+void BM_nativeGradient(benchmarkState &state)
+{
+    const char *dir = getenv("GREENS_NATIVE");
+    nativeKernel *kernel = nativeEnable(dir != NULL ? dir : "/tmp/greens-native") ? nativeLookup(ELLIPSE) : NULL;
+    if(kernel == NULL || !nativeWait(kernel))
+    {
+        static bool warned = false;
+        if(!warned)
+            fprintf(stderr, "Warning: no native kernel, BM_nativeGradient times partialDiff\n");
+        warned = true;
+        BM_partialDiff(state);
+        return;
+    }
+    double partials[3];
+    size_t i = 0;
+    while(state.keepRunning())
+    {
+        kernel->gradient(0.001 * (i & 1023), 2.0, partials);
+        doNotOptimize(partials[0]);
+        i++;
+    }
+    state.addCounter("evals", 3.0 * state.iterations());
+}
+
+BENCHMARK(BM_eval);
+BENCHMARK(BM_evalBlock);
+BENCHMARK(BM_numericalPartialDiff);
+BENCHMARK(BM_partialDiff);
+BENCHMARK(BM_evalInterval);
+BENCHMARK(BM_blackBirdN);
+BENCHMARK(BM_calcArea);
+BENCHMARK(BM_greens);
+BENCHMARK(BM_chenLai);
+BENCHMARK(BM_findLL);
+BENCHMARK(BM_modifiedGraham);
+BENCHMARK(BM_convexHull);
+BENCHMARK(BM_quickHullCollinear);
+BENCHMARK(BM_HyadesParabola);
+BENCHMARK(BM_MidnightOilCycle);
+BENCHMARK(BM_CygnusEllipse);
+BENCHMARK(BM_zeroSetEllipse);
+BENCHMARK(BM_nativeGradient);
+
+int main(int argc, char *argv[])
+{
+    return runBenchmarks(argc, argv);
+}
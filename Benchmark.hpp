@@ -0,0 +1,184 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Benchmark - small benchmark harness in the style of Google Benchmark, so the suite builds with nothing but the compiler.
+A benchmark is a function that runs its kernel once per pass of the state loop and reports how much work it did:
+    void BM_eval(benchmarkState &state)
+    {
+        ...setup...
+        while(state.keepRunning())
+            doNotOptimize(...kernel...);
+        state.addCounter("evals", state.iterations());
+    }
+    BENCHMARK(BM_eval);
+The harness doubles(or scales up) the number of iterations until one run takes at least the minimum time, then reports
+the time per iteration and every counter as a rate per second(points/s, evals/s...). Work that must not be timed, such as
+restoring the input of an in-place kernel, goes between pauseTiming and resumeTiming.
+Options: --filter=text(only benchmarks whose name contains text), --min_time=seconds(default 0.5), --format=csv*/
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*****************************Structure Definitions**************************/
+//State of one run of a benchmark: the iteration loop, timing and counters
+class benchmarkState {
+public:
+    benchmarkState(size_t iterations1) : todo(iterations1), done(0), paused(0.0), running(false) {}
+    //Function to run the next iteration, starts the clock on the first call and stops it after the last one
+    bool keepRunning()
+    {
+        if(done == 0 && !running)
+        {
+            running = true;
+            start = std::chrono::steady_clock::now();
+        }
+        if(done < todo)
+        {
+            done++;
+            return true;
+        }
+        stop = std::chrono::steady_clock::now();
+        running = false;
+        return false;
+    }
+    //Function to stop the clock for work that is not part of the kernel
+    void pauseTiming()
+    {
+        pauseStart = std::chrono::steady_clock::now();
+    }
+    //Function to start the clock again after pauseTiming
+    void resumeTiming()
+    {
+        paused += std::chrono::duration<double>(std::chrono::steady_clock::now() - pauseStart).count();
+    }
+    //Function to report amount units of work done by the whole run, reported as units per second
+    void addCounter(const std::string &name, double amount)
+    {
+        counterNames.push_back(name);
+        counterAmounts.push_back(amount);
+    }
+    size_t iterations() const
+    {
+        return todo;
+    }
+    //Function to obtain the timed seconds of the run
+    double seconds() const
+    {
+        return std::chrono::duration<double>(stop - start).count() - paused;
+    }
+    std::vector<std::string> counterNames;
+    std::vector<double> counterAmounts;
+private:
+    size_t todo, done;
+    std::chrono::steady_clock::time_point start, stop, pauseStart;
+    double paused;//Seconds spent between pauseTiming and resumeTiming
+    bool running;
+};
+
+typedef void (*benchmarkFunction)(benchmarkState &);
+//One registered benchmark
+struct benchmarkEntry {
+    std::string name;
+    benchmarkFunction function;
+};
+
+/**********************Function Declarations**********************************/
+template <class T> void doNotOptimize(const T &);//Function to keep the compiler from dropping a result
+std::vector<benchmarkEntry> &benchmarkRegistry();//Function to obtain the list of registered benchmarks
+int runBenchmarks(int, char *[]);//Function to run the registered benchmarks
+
+//Function to keep the compiler from dropping a result that is never used, or hoisting its computation out of the loop
+template <class T> inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+//Function to obtain the list of registered benchmarks, in registration order
+inline std::vector<benchmarkEntry> &benchmarkRegistry()
+{
+    static std::vector<benchmarkEntry> registry;
+    return registry;
+}
+
+//Registers a benchmark before main runs
+struct benchmarkRegistrar {
+    benchmarkRegistrar(const char *name, benchmarkFunction function)
+    {
+        benchmarkEntry entry;
+        entry.name = name;
+        entry.function = function;
+        benchmarkRegistry().push_back(entry);
+    }
+};
+#define BENCHMARK(function) static benchmarkRegistrar function##Registrar(#function, function)
+
+/*Function to run every registered benchmark that matches --filter. Each benchmark is run with 1 iteration, then with more
+iterations(scaled from the time of the last run, at least doubled) until a run takes --min_time seconds*/
+inline int runBenchmarks(int argc, char *argv[])
+{
+    std::string filter;
+    double minTime = 0.5;
+    bool csv = false;
+    int i;
+    for(i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--filter=", 9) == 0)
+            filter = argv[i] + 9;
+        else if(strncmp(argv[i], "--min_time=", 11) == 0)
+            minTime = atof(argv[i] + 11);
+        else if(strcmp(argv[i], "--format=csv") == 0)
+            csv = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--filter=text] [--min_time=seconds] [--format=csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(csv)
+        printf("name,iterations,ns_per_iteration,counters\n");
+    else
+        printf("%-32s %14s %14s  %s\n", "Benchmark", "Time/iter(ns)", "Iterations", "Rates");
+    std::vector<benchmarkEntry> &registry = benchmarkRegistry();
+    size_t b, c;
+    for(b = 0; b < registry.size(); b++)
+    {
+        if(!filter.empty() && registry[b].name.find(filter) == std::string::npos)
+            continue;
+        size_t iterations = 1;
+        while(true)
+        {
+            benchmarkState state(iterations);
+            registry[b].function(state);
+            double seconds = state.seconds();
+            if(seconds >= minTime || iterations >= 1000000000)
+            {
+                std::string rates;
+                for(c = 0; c < state.counterNames.size(); c++)
+                {
+                    char rate[96];
+                    snprintf(rate, sizeof(rate), csv ? "%s%s/s=%.6g" : "%s%s/s=%-12.4g", c ? (csv ? ";" : " ") : "", state.counterNames[c].c_str(), state.counterAmounts[c] / seconds);
+                    rates += rate;
+                }
+                if(csv)
+                    printf("%s,%zu,%.3f,%s\n", registry[b].name.c_str(), iterations, 1e9 * seconds / iterations, rates.c_str());
+                else
+                    printf("%-32s %14.1f %14zu  %s\n", registry[b].name.c_str(), 1e9 * seconds / iterations, iterations, rates.c_str());
+                fflush(stdout);
+                break;
+            }
+            double scale = seconds > 0.0 ? 1.4 * minTime / seconds : 100.0;//Aim a bit past minTime
+            iterations = (size_t)(iterations * (scale < 2.0 ? 2.0 : (scale > 100.0 ? 100.0 : scale)));
+        }
+    }
+    return 0;
+}
+
+#endif
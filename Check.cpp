@@ -0,0 +1,125 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Check - regression checks for bugs that were fixed, so they stay fixed. Each check runs once and returns an empty string
+if it passes or what went wrong. Cygnus is a whole program, so it is compiled into its own namespace with its main renamed,
+as in Bench.cpp.
+Build: c++ -O2 -pthread Check.cpp -o Check
+Run:   ./Check, exits with 1 if any check fails*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include "exprtk.hpp"
+#include "PolygonArea.h"
+#include "ExpressionTree.hpp"
+#include "Manifest.hpp"
+#include "Daemon.hpp"
+#include "Scheduler.hpp"
+#include "Greens.hpp"
+#include "Instrument.hpp"
+#include "TraceSink.hpp"
+#include "NativeKernel.hpp"
+#include "ZeroSet.hpp"
+#include "ConvexHull.hpp"
+
+#define main cygnusMain
+namespace cygnus {
+#include "Cygnus.cpp"
+}
+#undef main
+
+using namespace std;
+
+/*****************************Structure Definitions**************************/
+//Point in the plane for the hull checks
+struct point {
+    double x;
+    double y;
+};
+typedef string (*checkFunction)();
+//One regression check
+struct checkEntry {
+    const char *name;
+    checkFunction function;
+};
+
+/**********************Function Declarations**********************************/
+string checkFoldedGradient();//Function to check a shape whose symbolic gradient folds to nan
+string checkQuickHullCollinear();//Function to check Quickhull against monotone chain on rows of collinear hull points
+
+/*Cygnus: a circle plus x*acos(2), whose symbolic gradient folds to nan. ExprTk cannot compile "nan", so the gradient must
+not be symbolic, and the shape must fail on its own with an error instead of ending the program*/
+string checkFoldedGradient()
+{
+    const string function = "x*x+y*y-1+x*acos(2)";
+    string dfdx, dfdy;
+    if(symbolicGradient(function, dfdx, dfdy))
+        return "symbolic gradient of " + function + " is " + dfdx + ", " + dfdy;
+    manifestShape shape;
+    shape.lines.resize(1);
+    parseManifestLine("segment 0 1 0 1 " + function, 1, shape.lines[0]);
+    shapeResult result = cygnus::computeShape(shape);
+    if(result.ok || result.error.empty())
+        return "shape " + function + " did not fail with an error";
+    return "";
+}
+
+/*Parallel Quickhull of a shuffled lattice whose top and bottom rows are hull edges parallel to the line between the
+leftmost and rightmost points, every point of those rows is equally far from it. Quickhull must give the same 6 vertices
+as monotone chain, not a point from the middle of a row*/
+string checkQuickHullCollinear()
+{
+    vector<point> cloud;
+    point p;
+    int i, j;
+    for(j = 0; j < 256; j++)
+    {
+        for(i = 1; i < 255; i++)
+        {
+            p.x = i;
+            p.y = j;
+            cloud.push_back(p);
+        }
+    }
+    p.y = 127.5;
+    p.x = 0.0;
+    cloud.push_back(p);
+    p.x = 255.0;
+    cloud.push_back(p);
+    mt19937_64 random(12345);
+    shuffle(cloud.begin(), cloud.end(), random);
+    size_t chain = convexHull(cloud, HULL_MONOTONE_CHAIN).size(), quick = convexHull(cloud, HULL_QUICKHULL, 4).size();
+    if(chain != 6 || quick != chain)
+        return "hull of the lattice has " + to_string(chain) + " vertices by monotone chain, " + to_string(quick) +
+               " by Quickhull";
+    return "";
+}
+
+const checkEntry CHECKS[] = {
+    {"folded gradient", checkFoldedGradient},
+    {"quickhull collinear", checkQuickHullCollinear},
+};
+
+int main()
+{
+    int failed = 0;
+    size_t i;
+    for(i = 0; i < sizeof(CHECKS) / sizeof(CHECKS[0]); i++)
+    {
+        string error = CHECKS[i].function();
+        if(error.empty())
+            printf("ok    %s\n", CHECKS[i].name);
+        else
+        {
+            printf("FAIL  %s: %s\n", CHECKS[i].name, error.c_str());
+            failed++;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
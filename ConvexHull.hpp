@@ -0,0 +1,242 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*ConvexHull - convex hull of a set of points in the plane, so that only the vertices of the hull are given to the area
+formula. Two algorithms: Andrew's monotone chain(sort by x then two scans, O(n log n)) and Quickhull(recursively split off
+the points outside the furthest point of each edge, O(n) per level) which runs on several threads for very large sets.
+Both give the same vertices: Quickhull breaks ties for the furthest point towards the end of the edge and drops
+collinear points when it joins its chains.
+Works with any point type that has double members x and y. The hull is returned counterclockwise starting at the
+leftmost(then lowest) point, without duplicate or collinear points*/
+
+#ifndef CONVEX_HULL_HPP
+#define CONVEX_HULL_HPP
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include "PolygonArea.h"
+
+/*****************************Structure Definitions**************************/
+//Algorithm used to find the hull
+enum hullMethod {
+    HULL_AUTO,//Monotone chain, or Quickhull for sets of at least QUICKHULL_MIN_POINTS points
+    HULL_MONOTONE_CHAIN,//Andrew's monotone chain
+    HULL_QUICKHULL//Parallel Quickhull
+};
+
+const size_t QUICKHULL_MIN_POINTS = 1 << 20;//Number of points from which HULL_AUTO uses Quickhull
+const size_t QUICKHULL_GRAIN = 1 << 15;//Point sets smaller than this are handled by one thread
+
+/**********************Function Declarations**********************************/
+template <class P> double orientation(const P &, const P &, const P &);//Function to determine on which side of a line a point lies
+template <class P> bool lessXY(const P &, const P &);//Function to order points by x, then y
+template <class P> std::vector<P> monotoneChain(std::vector<P>);//Function to find the hull with Andrew's monotone chain
+template <class P> bool furtherFrom(const P &, const P &, const P &, double, const P &, double);//Function to determine if a point is further outside a hull edge than another
+template <class P> void outsidePoints(const P &, const P &, const std::vector<P> &, std::vector<P> &, P &, unsigned);//Function to find the points outside a hull edge
+template <class P> void dropCollinear(std::vector<P> &);//Function to remove the collinear vertices of a convex polygon
+template <class P> void quickHullEdge(const P &, const P &, const std::vector<P> &, const P &, std::vector<P> &, unsigned);//Function to find the hull vertices outside a hull edge
+template <class P> std::vector<P> quickHull(const std::vector<P> &, unsigned);//Function to find the hull with parallel Quickhull
+template <class P> std::vector<P> convexHull(const std::vector<P> &, hullMethod = HULL_AUTO, unsigned = 0);//Function to find the convex hull of a set of points
+
+/*Function to determine on which side of the line from a to b the point p lies. Returns twice the signed area of the
+triangle a, b, p: positive if p is to the left(counterclockwise), negative if to the right and 0 if collinear. The cross
+product is calculated with crossDiff(FMA corrected) so the sign is right for nearly collinear points*/
+template <class P> inline double orientation(const P &a, const P &b, const P &p)
+{
+    return crossDiff(b.x - a.x, p.y - a.y, b.y - a.y, p.x - a.x);
+}
+
+//Function to order points by x, then y
+template <class P> inline bool lessXY(const P &p, const P &q)
+{
+    return p.x < q.x || (p.x == q.x && p.y < q.y);
+}
+
+/*Function to find the convex hull with Andrew's monotone chain. After sorting by x the lower hull is built from left to
+right and the upper hull from right to left, a point is popped whenever the last two points and the new one do not turn
+counterclockwise. Duplicates end up next to each other after sorting and are dropped first*/
+template <class P> std::vector<P> monotoneChain(std::vector<P> points)
+{
+    std::sort(points.begin(), points.end(), lessXY<P>);
+    points.erase(std::unique(points.begin(), points.end(), [](const P &p, const P &q) { return p.x == q.x && p.y == q.y; }), points.end());
+    size_t n = points.size();
+    if(n < 3)
+        return points;
+    std::vector<P> hull(2 * n);
+    size_t k = 0, i;
+    for(i = 0; i < n; i++)//Lower hull
+    {
+        while(k >= 2 && orientation(hull[k - 2], hull[k - 1], points[i]) <= 0.0)
+            k--;
+        hull[k++] = points[i];
+    }
+    size_t lowerSize = k + 1;
+    for(i = n - 1; i-- > 0;)//Upper hull
+    {
+        while(k >= lowerSize && orientation(hull[k - 2], hull[k - 1], points[i]) <= 0.0)
+            k--;
+        hull[k++] = points[i];
+    }
+    hull.resize(k - 1);//Last point is the first one again
+    return hull;
+}
+
+/*Function to determine if p(distance dist from the line from a to b) is further outside the edge a, b than q(distance
+qDist). Points equally far from the line lie on one hull edge parallel to a, b, the one furthest towards b wins so it is
+an end of that edge and never a point in its middle*/
+template <class P> inline bool furtherFrom(const P &a, const P &b, const P &p, double dist, const P &q, double qDist)
+{
+    if(dist != qDist)
+        return dist > qDist;
+    return (p.x - q.x) * (b.x - a.x) + (p.y - q.y) * (b.y - a.y) > 0.0;
+}
+
+/*Function to find the points of a set that lie strictly to the right of the line from a to b(outside the hull edge a, b),
+and the one furthest from the line(see furtherFrom). Large sets are split into one chunk per thread*/
+template <class P> void outsidePoints(const P &a, const P &b, const std::vector<P> &points, std::vector<P> &outside, P &furthest, unsigned numThreads)
+{
+    size_t n = points.size();
+    unsigned chunks = (n >= 2 * QUICKHULL_GRAIN && numThreads > 1) ? (unsigned)std::min((size_t)numThreads, n / QUICKHULL_GRAIN) : 1;
+    std::vector< std::vector<P> > chunkPoints(chunks);
+    std::vector<double> chunkDist(chunks, 0.0);
+    std::vector<P> chunkFurthest(chunks);
+    auto scan = [&](unsigned c)
+    {
+        size_t i, end = n * (c + 1) / chunks;
+        for(i = n * c / chunks; i < end; i++)
+        {
+            double dist = -orientation(a, b, points[i]);//Distance from the line times |b - a|
+            if(dist > 0.0)
+            {
+                chunkPoints[c].push_back(points[i]);
+                if(chunkPoints[c].size() == 1 || furtherFrom(a, b, points[i], dist, chunkFurthest[c], chunkDist[c]))
+                {
+                    chunkDist[c] = dist;
+                    chunkFurthest[c] = points[i];
+                }
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    unsigned c;
+    for(c = 1; c < chunks; c++)
+        workers.push_back(std::thread(scan, c));
+    scan(0);
+    for(c = 0; c < workers.size(); c++)
+        workers[c].join();
+    size_t total = 0;
+    double maxDist = 0.0;
+    for(c = 0; c < chunks; c++)//Merge in chunk order
+    {
+        total += chunkPoints[c].size();
+        if(!chunkPoints[c].empty() && (maxDist == 0.0 || furtherFrom(a, b, chunkFurthest[c], chunkDist[c], furthest, maxDist)))
+        {
+            maxDist = chunkDist[c];
+            furthest = chunkFurthest[c];
+        }
+    }
+    outside.clear();
+    outside.reserve(total);
+    for(c = 0; c < chunks; c++)
+        outside.insert(outside.end(), chunkPoints[c].begin(), chunkPoints[c].end());
+}
+
+/*Function to find the hull vertices between a and b, given the points strictly to the right of the edge a, b. The
+furthest point c is on the hull, so the points inside the triangle a, c, b are dropped and the two new edges a, c and
+c, b are handled the same way. For large sets the two halves are handled on separate threads*/
+template <class P> void quickHullEdge(const P &a, const P &b, const std::vector<P> &points, const P &c, std::vector<P> &chain, unsigned numThreads)
+{
+    if(points.empty())
+        return;
+    std::vector<P> outsideAC, outsideCB, chainAC, chainCB;
+    P furthestAC, furthestCB;
+    outsidePoints(a, c, points, outsideAC, furthestAC, numThreads);
+    outsidePoints(c, b, points, outsideCB, furthestCB, numThreads);
+    if(numThreads > 1 && outsideAC.size() >= QUICKHULL_GRAIN && outsideCB.size() >= QUICKHULL_GRAIN)
+    {
+        unsigned half = numThreads / 2;
+        std::thread worker([&]() { quickHullEdge(a, c, outsideAC, furthestAC, chainAC, half); });
+        quickHullEdge(c, b, outsideCB, furthestCB, chainCB, numThreads - half);
+        worker.join();
+    }
+    else
+    {
+        quickHullEdge(a, c, outsideAC, furthestAC, chainAC, numThreads);
+        quickHullEdge(c, b, outsideCB, furthestCB, chainCB, numThreads);
+    }
+    chain.insert(chain.end(), chainAC.begin(), chainAC.end());
+    chain.push_back(c);
+    chain.insert(chain.end(), chainCB.begin(), chainCB.end());
+}
+
+/*Function to remove the vertices of a convex polygon that do not turn counterclockwise, such as the middle points of
+collinear runs. The first vertex is the leftmost(then lowest) point, which is always a corner*/
+template <class P> void dropCollinear(std::vector<P> &hull)
+{
+    size_t k = 0, i;
+    for(i = 0; i < hull.size(); i++)
+    {
+        while(k >= 2 && orientation(hull[k - 2], hull[k - 1], hull[i]) <= 0.0)
+            k--;
+        hull[k++] = hull[i];
+    }
+    while(k >= 3 && orientation(hull[k - 2], hull[k - 1], hull[0]) <= 0.0)//Last vertices against the first one
+        k--;
+    hull.resize(k);
+}
+
+/*Function to find the convex hull with Quickhull on numThreads threads(0 uses every core). The line from the leftmost to
+the rightmost point splits the set in two, and each side is handled by quickHullEdge. Collinear points left where the
+chains join are dropped at the end*/
+template <class P> std::vector<P> quickHull(const std::vector<P> &points, unsigned numThreads)
+{
+    if(numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    if(points.size() < 3)
+        return monotoneChain(points);
+    size_t i, left = 0, right = 0;
+    for(i = 1; i < points.size(); i++)
+    {
+        if(lessXY(points[i], points[left]))
+            left = i;
+        if(lessXY(points[right], points[i]))
+            right = i;
+    }
+    P l = points[left], r = points[right];
+    std::vector<P> hull(1, l);
+    if(l.x == r.x && l.y == r.y)//Every point is the same
+        return hull;
+    std::vector<P> below, above, lowerChain, upperChain;
+    P furthestBelow, furthestAbove;
+    outsidePoints(l, r, points, below, furthestBelow, numThreads);
+    outsidePoints(r, l, points, above, furthestAbove, numThreads);
+    if(numThreads > 1 && below.size() >= QUICKHULL_GRAIN && above.size() >= QUICKHULL_GRAIN)
+    {
+        unsigned half = numThreads / 2;
+        std::thread worker([&]() { quickHullEdge(l, r, below, furthestBelow, lowerChain, half); });
+        quickHullEdge(r, l, above, furthestAbove, upperChain, numThreads - half);
+        worker.join();
+    }
+    else
+    {
+        quickHullEdge(l, r, below, furthestBelow, lowerChain, numThreads);
+        quickHullEdge(r, l, above, furthestAbove, upperChain, numThreads);
+    }
+    hull.insert(hull.end(), lowerChain.begin(), lowerChain.end());
+    hull.push_back(r);
+    hull.insert(hull.end(), upperChain.begin(), upperChain.end());
+    dropCollinear(hull);
+    return hull;
+}
+
+//Function to find the convex hull of a set of points, counterclockwise from the leftmost point
+template <class P> std::vector<P> convexHull(const std::vector<P> &points, hullMethod method, unsigned numThreads)
+{
+    if(method == HULL_QUICKHULL || (method == HULL_AUTO && points.size() >= QUICKHULL_MIN_POINTS))
+        return quickHull(points, numThreads);
+    return monotoneChain(points);
+}
+
+#endif
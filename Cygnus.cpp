@@ -7,16 +7,32 @@ Cygnus -The seventh major iteration of our Algorithm to numerically do Green's T
 
 #include <iostream>
 #include <vector>
-#include <util>
+#include <utility>
+#include <algorithm>
 #include <cmath>
 #include <string>
+#include <unordered_map>
 #include <ctime>
-#include "exprtk.hpp"
+#include "Greens.hpp"
+#include "Manifest.hpp"
+#include "Daemon.hpp"
+#include "Instrument.hpp"
+#include "TraceSink.hpp"
+#include "NativeKernel.hpp"
+#include "ZeroSet.hpp"
 using namespace std;
 
-double STEP_SIZE = 0.1;//Step Size
-double h = 0.0000001;//Needed for numerical differentiation
+double STEP_SIZE = 0.1;//Initial step size, adapted to the curvature as the traversal goes
+double TOLERANCE = 0.0001;//Max distance allowed between the boundary polygon and the curve
+double MIN_STEP = 0.000001;//Smallest step the controller may take
+double MAX_STEP = 1.0;//Largest step the controller may take
 double EPSILON = 0.00001;//Epsilon needed for operations with doubles
+double NEWTON_TOLERANCE = 0.000000000001;//Corrector stops once |f| is this small
+int MAX_NEWTON_ITERATIONS = 20;//Corrector gives up after this many iterations
+long MAX_STEPS = 10000000;//Traversal gives up after this many steps
+double MAX_ARC = 10000.0;//Traversal gives up after an arc length of this many times the scale of the segment
+unsigned NUM_THREADS = 0;//Number of batch worker threads, 0 uses every core
+double CELL_SIZE = 0.01;//Leaf size of the quadtree of region shapes(see ZeroSet.hpp)
 
 //Overload == operator for use with pairs of doubles
 inline bool operator == (pair<double,double> const& p, pair<double,double> const& q)
@@ -32,118 +48,355 @@ struct functionStruct {
     pair<double,double> end;//End point of traversal. For a closed loop, start = end
 };
 
-vector<pair<double,double>> orderedPoints;//Stores points in order
-//Type definitions from ExprTk library
-typedef exprtk::symbol_table<double> symbol_table_t;
-typedef exprtk::expression<double> expression_t;
-typedef exprtk::parser<double> parser_t;
-expression_t expression;//Setting up evaluation infrastructure-no need to do this multiple times
-parser_t parser;
-symbol_table_t symbol_table;
+/*Everything one Cygnus traversal works on. Compiled expressions and derivatives are those of the greens library(see
+Greens.hpp), so a context owns its own ExprTk parser and caches and contexts share nothing. A context must be used by one
+thread at a time, batch workers each have their own*/
+struct cygnusContext {
+    greensContext greens;//Compiled f(x,y) and its derivatives
+    vector<pair<double,double>> orderedPoints;//Stores points in order
+    pair<double,double> tangent;//Unit tangent of the previous step, keeps the traversal going in one direction
+    double stepSize;//Current step size
+    cygnusContext() : stepSize(STEP_SIZE) {}
+};
+thread_local cygnusContext context;//Traversal state of this thread
 
 /**********************Function Declarations**********************************/
-void printPoint();//Function to print a strung representation of a point
-void traversal(functionStruct);//Function to obtain points along boundary of shape
-pair<double,double> getPoint(pair<double,double>, functionStruct);//Function to determine the next point in the search
-double eval(pair<double,double>, double, double);//Function to evaluate the function at a point (x,y)
-double *numericalGrad(string, double, double);//Function to numerically calculate the partial derivatives a two-variable function f(x,y)
-double calcArea(vector<pair<double,double>>);//Function to calculate area
-
-//Evaluate a function f(x,y) at a point (x,y), return value of function at point (x,y)
-double eval(string function, double a, double b)
-{
-  symbol_table.add_constants();
-  symbol_table.add_variable("x", a);
-  symbol_table.add_variable("y", b);
-  expression.register_symbol_table(symbol_table);
-  if(!(parser.compile(function, expression)))//If f(x,y) is not a valid expression that can be evaluated by ExprTk
-  {
-    printf("Error: %s\tExpression: %s\n", parser.error().c_str(), function.c_str());
-    exit(1);
-  }
-  double result = expression.value();
-  return result;
-}
+bool traversal(cygnusContext &, const functionStruct &, string &);//Function to obtain points along boundary of shape
+bool traceSegment(cygnusContext &, const functionStruct &, vector<pair<double,double>> &, string &);//Function to trace one segment
+pair<double,double> getPoint(cygnusContext &, pair<double,double>, const functionStruct &);//Function to determine the next point in the search
+bool correct(cygnusContext &, pair<double,double> &, const string &);//Function to move a point back onto the curve f(x,y) = 0
+double calcArea(const vector<pair<double,double>> &);//Function to calculate area
+bool traceRegion(cygnusContext &, const string &, const double[], shapeResult &);//Function to find the whole boundary of a region without start points
+shapeResult computeShape(const manifestShape &);//Function to calculate the area of one shape of a batch manifest
 
 /*
 Given function f(x,y) = 0 for boundary(or segment of boundary of shape), obtain
-points (x,y) along boundary of shape to then calculate area.
+points (x,y) along boundary of shape to then calculate area. The traversal ends once it
+comes within one step of the end point after having moved at least one step away from the start. If the trace sink is
+open(see TraceSink.hpp) every point is recorded there. The points are added to ctx.orderedPoints.
+Returns false with the reason in error if the gradient of f is zero or undefined on the way, an open segment comes back
+to its start(the end point is not on the curve through the start), or the arc length grows past MAX_ARC times the scale
+of the segment: the larger of 1, the distance from start to end and their distances from the origin.
 */
-void traversal(functionStruct fs1)
+bool traversal(cygnusContext &ctx, const functionStruct &fs1, string &error)
 {
+    INSTRUMENT_STAGE(TRACE);
     pair<double,double> curPoint, end, next;
     curPoint = fs1.start;
     end = fs1.end;
-    orderedPoints.push_back(curPoint);//Adding starting and first point to storage
-    curPoint = getPoint(curPoint, fs1);
-    orderedPoints.push_back(curPoint);
-    while(!(curPoint == end))//Doing traversal
+    greensLatch(ctx.greens, fs1.function);//One derivative method for the whole segment
+    double partials[3];
+    partialDiff(ctx.greens, fs1.function, curPoint.first, curPoint.second, partials);
+    double norm = sqrt(partials[0] * partials[0] + partials[1] * partials[1]);
+    if(!(norm > 0.0) || !isfinite(norm))//No tangent to follow
+    {
+      error = "traversal of " + fs1.function + ": gradient is zero or undefined at the start point";
+      return false;
+    }
+    ctx.tangent.first = -partials[1] / norm;//Gradient rotated counterclockwise: counterclockwise around regions where f < 0
+    ctx.tangent.second = partials[0] / norm;
+    if(!(fs1.start == fs1.end) && ctx.tangent.first * (end.first - curPoint.first) + ctx.tangent.second * (end.second - curPoint.second) < 0)
+    {
+        ctx.tangent.first *= -1;//Open segment, head towards the end point
+        ctx.tangent.second *= -1;
+    }
+    ctx.stepSize = STEP_SIZE;
+    bool trace = traceEnabled();
+    uint64_t path = trace ? traceBegin() : 0;
+    if(trace)
+      tracePoint(path, curPoint.first, curPoint.second);
+    ctx.orderedPoints.push_back(curPoint);//Adding starting point to storage
+    bool closed = fs1.start == fs1.end;
+    double scale = max(1.0, max(hypot(end.first - curPoint.first, end.second - curPoint.second),
+                                max(hypot(curPoint.first, curPoint.second), hypot(end.first, end.second))));
+    double travelled = 0.0;//Arc length covered so far
+    long steps;
+    for(steps = 0; steps < MAX_STEPS; steps++)//Doing traversal
     {
-      next = getPoints(curPoint, fs1);//Obtain next search point
-      orderedPoints.push_back(next);//Add to storage
+      next = getPoint(ctx, curPoint, fs1);//Obtain next search point
+      if(!isfinite(next.first) || !isfinite(next.second))
+      {
+        error = "traversal of " + fs1.function + ": gradient is zero or undefined on the curve";
+        break;
+      }
+      travelled += sqrt(pow(next.first - curPoint.first, 2) + pow(next.second - curPoint.second, 2));
+      double distEnd = sqrt(pow(next.first - end.first, 2) + pow(next.second - end.second, 2));
+      if(travelled > ctx.stepSize && distEnd < ctx.stepSize)//Reached the end point
+        break;
+      double distStart = sqrt(pow(next.first - fs1.start.first, 2) + pow(next.second - fs1.start.second, 2));
+      if(!closed && travelled > 4 * ctx.stepSize && distStart < ctx.stepSize)
+      {
+        error = "traversal of " + fs1.function + " came back to its start without reaching the end point";
+        break;
+      }
+      if(travelled > MAX_ARC * scale)
+      {
+        error = "traversal of " + fs1.function + " did not reach the end point within its maximum arc length";
+        break;
+      }
+      INSTRUMENT_COUNT(STEPS, 1);
+      if(trace)
+        tracePoint(path, next.first, next.second);
+      ctx.orderedPoints.push_back(next);//Add to storage
       curPoint = next;
     }
+    if(steps == MAX_STEPS)
+      error = "traversal of " + fs1.function + " did not reach the end point within its maximum number of steps";
+    if(!error.empty())
+    {
+      if(trace)
+        traceFlush();
+      return false;
+    }
+    if(!closed)//A closed loop is closed by calcArea, an open segment ends exactly at its end point
+    {
+      if(trace)
+        tracePoint(path, end.first, end.second);
+      ctx.orderedPoints.push_back(end);
+    }
+    if(trace)
+      traceFlush();//The path goes to the writer before this thread moves on
+    return true;
+}
+
+//Function to trace one segment with ctx, its points are moved to points. Returns false with the reason in error
+bool traceSegment(cygnusContext &ctx, const functionStruct &fs1, vector<pair<double,double>> &points, string &error)
+{
+    ctx.orderedPoints.clear();
+    bool ok = traversal(ctx, fs1, error);
+    points.swap(ctx.orderedPoints);
+    return ok;
 }
 
 /*Function that determines the next point on the boundary to traverse by finging the tangent line
 to the boundary curve at that point, moving a fixed step distance along the tangent line,
 comuting the normal to the line at that point, and then finding where the normal line and
-the boundary curve intersect. This is called the SirFrancisDrake Algorithm*/
-pair<double,double> getPoint(pair<double,double> curPoint, functionStruct f1)
+the boundary curve intersect. This is called the SirFrancisDrake Algorithm. The predictor moves
+stepSize along the tangent and the corrector is Newton's method along the gradient, so every
+point lies on the curve to within NEWTON_TOLERANCE and the polygon error is O(stepSize^2).
+
+The step size is adapted to the local curvature k. The corrector moves the predicted point a distance
+of about k*step^2/2, four times the distance between the chord and the arc(k*step^2/8), so the
+correction size tells us the curvature for free: steps whose chord would be further than TOLERANCE
+from the curve are redone with half the step, and the next step is scaled so its chord error is
+about TOLERANCE. Straight stretches get long steps and tight bends get short ones*/
+pair<double,double> getPoint(cygnusContext &ctx, pair<double,double> curPoint, const functionStruct &f1)
 {
-    /*REDO*/
+    double partials[3];
+    partialDiff(ctx.greens, f1.function, curPoint.first, curPoint.second, partials);
+    double norm = sqrt(partials[0] * partials[0] + partials[1] * partials[1]);
+    pair<double,double> t(-partials[1] / norm, partials[0] / norm);//Unit tangent at curPoint
+    if(t.first * ctx.tangent.first + t.second * ctx.tangent.second < 0)//Keep going the same way as the previous step
+    {
+        t.first *= -1;
+        t.second *= -1;
+    }
+    ctx.tangent = t;
+    pair<double,double> next;
+    double correction;//Distance the corrector moved the predicted point
+    while(1)
+    {
+        pair<double,double> predicted(curPoint.first + ctx.stepSize * t.first, curPoint.second + ctx.stepSize * t.second);
+        next = predicted;
+        bool converged = correct(ctx, next, f1.function);
+        correction = sqrt(pow(next.first - predicted.first, 2) + pow(next.second - predicted.second, 2));
+        if((converged && correction <= 4 * TOLERANCE) || ctx.stepSize <= MIN_STEP)
+            break;
+        ctx.stepSize = max(ctx.stepSize / 2, MIN_STEP);//Step too long for this bend, redo it
+    }
+    //Chord error grows with step^2, aim the next step at TOLERANCE but grow by at most 2x per step
+    double scale = (correction > 0.0) ? 0.9 * sqrt(4 * TOLERANCE / correction) : 2.0;
+    ctx.stepSize = min(MAX_STEP, max(MIN_STEP, ctx.stepSize * min(2.0, scale)));
+    return next;
 }
 
-//Function to numerically calculate the gradient of a function f(x,y) at point (a,b)
-double* numericalGrad(string function, double a, double b)
+//Function to move a point back onto the curve f(x,y) = 0 with Newton's method along the gradient, returns false if it did not converge
+bool correct(cygnusContext &ctx, pair<double,double> &p, const string &function)
 {
-    double partials[2];
-    double *returnPtr;
-    returnPtr = partials;
-    partials[0] = (eval(function, a + h, b) - eval(function, a - h, b)) / (2 * h);//df/dx
-    partials[1] = (eval(function, a, b + h) - eval(function, a, b - h)) / (2 * h);//df/dy
-    return returnPtr;//Return as array
+    double partials[3];
+    int i;
+    for(i = 0; i < MAX_NEWTON_ITERATIONS; i++)
+    {
+        INSTRUMENT_COUNT(NEWTON, 1);
+        partialDiff(ctx.greens, function, p.first, p.second, partials);
+        if(abs(partials[2]) <= NEWTON_TOLERANCE)
+            return true;
+        double normsq = partials[0] * partials[0] + partials[1] * partials[1];
+        if(normsq == 0.0)//Critical point, nothing better to do
+            return false;
+        p.first -= partials[2] * partials[0] / normsq;
+        p.second -= partials[2] * partials[1] / normsq;
+    }
+    return false;
 }
 
-//Evaluate a function f(x,y) at a point (x,y), return value of function at point (x,y)
-double eval(string function, double a, double b)
+/*Function that actually calculates area, given points along boundary of shape
+using variation of Green's Theorem*/
+double calcArea(const vector<pair<double,double>> &orderedPoints)
 {
-  symbol_table.add_constants();
-  symbol_table.add_variable("x", a);
-  symbol_table.add_variable("y", b);
-  expression.register_symbol_table(symbol_table);
-  if(!(parser.compile(function, expression)))//If f(x,y) is not a valid expression that can be evaluated by ExprTk
+  INSTRUMENT_STAGE(AREA);
+  if(orderedPoints.empty())
+    return 0.0;
+  return polygonArea(&orderedPoints[0].first, &orderedPoints[0].second, orderedPoints.size(), 2);
+}
+
+/*Function to find the whole boundary of the region f(x,y) < 0 inside the box xmin, xmax, ymin, ymax(box) with the
+quadtree of ZeroSet.hpp, leaves CELL_SIZE wide. Every component and hole is found without start points. Subtrees are
+tasks of the active pool, each thread evaluates f with its own context. ctx.orderedPoints is given the polygons one
+after another and each polygon is a path of the trace sink. Returns false with the reason in result.error if the box is
+empty*/
+bool traceRegion(cygnusContext &ctx, const string &function, const double box[], shapeResult &result)
+{
+  zeroSetEvaluator evaluate = [&function](const double *xs, const double *ys, double *values, int n) {
+    evalBlock(context.greens, function, xs, ys, values, n);//context of the thread running the subtree
+  };
+  zeroSetResult zeroSet;
+  if(!zeroSetExtract(function, evaluate, box[0], box[1], box[2], box[3], CELL_SIZE, zeroSet))
   {
-    printf("Error: %s\tExpression: %s\n", parser.error().c_str(), function.c_str());
-    exit(1);
+    result.error = "region box is empty";
+    return false;
   }
-  double result = expression.value();
-  return result;
+  ctx.orderedPoints.clear();
+  bool trace = traceEnabled();
+  size_t i, k;
+  for(k = 0; k < zeroSet.polygons.size(); k++)
+  {
+    uint64_t path = trace ? traceBegin() : 0;
+    for(i = 0; i < zeroSet.polygons[k].size(); i++)
+    {
+      pair<double,double> p(zeroSet.polygons[k][i].x, zeroSet.polygons[k][i].y);
+      ctx.orderedPoints.push_back(p);
+      if(trace)
+        tracePoint(path, p.first, p.second);
+    }
+  }
+  if(trace)
+    traceFlush();
+  result.area = zeroSet.area;
+  result.points = zeroSet.points;
+  return true;
 }
 
-/*Function that actually calculates area, given points along boundary of shape
-using variation of Green's Theorem*/
-double calcArea(vector<pair<double,double>> orderedPoints)
+/*Function to calculate the area of one shape of a batch manifest. Each line of the shape is
+"segment startx starty endx endy f(x,y)", a closed loop has start = end. Or the shape is the single line
+"region xmin xmax ymin ymax f(x,y)": the area where f(x,y) < 0 inside the box, found without start points(see
+traceRegion). In a batch the segments are tasks of the work-stealing pool(see Scheduler.hpp), every worker traces with
+its own context and reuses its compiled expressions for every segment it is given*/
+shapeResult computeShape(const manifestShape &shape)
 {
-  double area = 0.0;
-  int idx = 0;//Index in vector
-  int numItr = 0;//Number of iterations(additions). Actual formula is defined using series
-  int size = orderedPoints.size();
-  while(numItr < size)
+  shapeResult result;
+  result.ok = false;
+  result.area = 0.0;
+  result.points = 0;
+  vector<functionStruct> segments;
+  size_t i;
+  for(i = 0; i < shape.lines.size(); i++)
+  {
+    const manifestLine &line = shape.lines[i];
+    functionStruct fs1;
+    double v[4];
+    if(line.keyword == "region")
+    {
+      if(shape.lines.size() != 1 || !takeNumbers(line.rest, 4, v, fs1.function) || fs1.function.empty())
+      {
+        result.error = "line " + to_string(line.line) + ": expected region xmin xmax ymin ymax f(x,y), alone in its shape";
+        return result;
+      }
+      if(greensCompile(context.greens, fs1.function) != GREENS_OK)
+      {
+        result.error = context.greens.error;
+        return result;
+      }
+      if(!traceRegion(context, fs1.function, v, result))
+        return result;
+      result.ok = true;
+      return result;
+    }
+    if(line.keyword != "segment" || !takeNumbers(line.rest, 4, v, fs1.function) || fs1.function.empty())
+    {
+      result.error = "line " + to_string(line.line) + ": expected segment startx starty endx endy f(x,y)";
+      return result;
+    }
+    fs1.start = make_pair(v[0], v[1]);
+    fs1.end = make_pair(v[2], v[3]);
+    if(greensCompile(context.greens, fs1.function) != GREENS_OK)//A bad function fails this shape, not the whole batch
+    {
+      result.error = context.greens.error;
+      return result;
+    }
+    segments.push_back(fs1);
+  }
+  if(segments.empty())
+  {
+    result.error = "shape has no segments";
+    return result;
+  }
+  vector< vector<pair<double,double>> > segmentPoints(segments.size());
+  vector<string> errors(segments.size());
+  workStealingPool *pool = activePool();
+  if(pool == NULL || segments.size() == 1)
   {
-      if(numItr < size - 1)
-          area += ((orderedPoints[idx].first * orderedPoints[idx + 1].second) - (orderedPoints[idx].second * orderedPoints[idx + 1].first));
-      else
-          area += ((orderedPoints[idx].first * orderedPoints[0].second) - (orderedPoints[0].first * orderedPoints[idx].second));
-      idx++;
-      numItr++;
+    for(i = 0; i < segments.size(); i++)
+      traceSegment(context, segments[i], segmentPoints[i], errors[i]);
   }
-  if(area < 0)//Area cannot be negative
-      area *= -1;
-  return (area / 2);
+  else//Segments are tasks idle batch workers can steal
+  {
+    taskGroup group;
+    for(i = 0; i < segments.size(); i++)
+      poolSpawn(*pool, group, [&segments, &segmentPoints, &errors, i]() { traceSegment(context, segments[i], segmentPoints[i], errors[i]); });
+    poolWait(*pool, group);
+  }
+  for(i = 0; i < segments.size(); i++)//The first segment that failed fails the shape
+  {
+    if(!errors[i].empty())
+    {
+      result.error = errors[i];
+      return result;
+    }
+  }
+  vector<pair<double,double>> boundary;
+  for(i = 0; i < segments.size(); i++)//Stitch in order
+    boundary.insert(boundary.end(), segmentPoints[i].begin(), segmentPoints[i].end());
+  context.orderedPoints.swap(boundary);
+  result.ok = true;
+  result.area = calcArea(context.orderedPoints);
+  result.points = context.orderedPoints.size();
+  return result;
 }
 
-int main() {
+/*Cygnus computes the shape below, with --batch every shape of a manifest(see Manifest.hpp)
+or with --daemon shape requests from stdin or a Unix socket(see Daemon.hpp):
+Cygnus --batch manifest.txt [results.csv]
+Cygnus --daemon [socket path]
+Any of them can be preceded by these options:
+--profile report.csv(or .json) to write the counters and stage times of every shape, in a build with -DGREENS_INSTRUMENT(see Instrument.hpp)
+--trace trace.csv(or .bin) to record every boundary point found(see TraceSink.hpp)
+--native kernels to compile each function to machine code, cached in the directory kernels(see NativeKernel.hpp)*/
+int main(int argc, char *argv[]) {
+  while(argc > 2)//Options, in any order
+  {
+    string option = argv[1];
+    if(option == "--profile")
+      instrumentProfile(argv[2]);
+    else if(option == "--trace")
+    {
+      if(!traceOpen(argv[2]))
+        return 1;
+    }
+    else if(option == "--native")
+    {
+      if(!nativeEnable(argv[2]))
+        return 1;
+    }
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc > 2 && string(argv[1]) == "--batch")
+    return runBatch(argv[2], argc > 3 ? argv[3] : NULL, NUM_THREADS, computeShape);
+  if(argc > 1 && string(argv[1]) == "--daemon")
+    return runDaemon(argc > 2 ? argv[2] : NULL, NUM_THREADS, computeShape);
   functionStruct fs0;
   fs0.function = "(x*x)+(x*y)+(y*y)-4";//Shape(Ellipse)
   pair<double,double> start1;
@@ -153,18 +406,23 @@ int main() {
   fs0.end = start1;
   vector<functionStruct> functionVector;
   functionVector.push_back(fs0);
+  INSTRUMENT_SHAPE("Cygnus");
   clock_t clk;
   clk = clock();
   int i;
   for(i = 0; i < functionVector.size(); i++)//Do search
   {
-    functionStruct fs1 = functionVector[i];
-    traversal(fs1);
+    string error;
+    if(!traversal(context, functionVector[i], error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
   }
-  double area = calcArea(orderedPoints);//Calculate area
+  double area = calcArea(context.orderedPoints);//Calculate area
   clk = clock() - clk;
   printf("The area of the shape is: %lf\n", area);
-  printf("Size of vector: %lu\n", orderedPoints.size());
+  printf("Size of vector: %lu\n", context.orderedPoints.size());
   printf("Runtime: %lf\n", ((double)clk) / CLOCKS_PER_SEC);
   return 0;
 }
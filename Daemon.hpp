@@ -0,0 +1,307 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Daemon - long running mode shared by the executables. Shape requests arrive on stdin or on a local Unix socket, a fixed
+pool of worker threads stays up for the whole run so every worker keeps its compiled expressions(thread_local parser,
+symbol table and caches) warm from request to request. Requests that arrive while the workers are busy queue up, and a
+worker takes the next one off the queue each time it is free. A slow shape only holds up its own worker: the requests
+behind it go to whichever worker is idle, and each reply is written to its client as soon as its shape is done.
+Protocol, one item per line, the lines of a request are the lines of a manifest shape(see Manifest.hpp):
+    shape <name>      starts a request(an open request is submitted first)
+    segment ...       point ..., file ..., binary ...: the lines of the shape
+    end               submits the request
+    quit              ends the session(end of input does the same)
+Every request gets one reply line in the batch CSV format: shape,area,points,seconds,error. Replies to requests of one
+client come back in the order the requests finish, the shape name tells them apart*/
+
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include <deque>
+#include <list>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "Manifest.hpp"
+
+/*****************************Structure Definitions**************************/
+//Where the replies of a session go, the connection is closed once the session and all its pending replies are done
+struct daemonClient {
+    int fd;
+    std::mutex writeLock;//Replies from different workers must not interleave
+    daemonClient(int fd1) : fd(fd1) {}
+    ~daemonClient()
+    {
+        if(fd > STDERR_FILENO)
+            close(fd);
+    }
+};
+
+//One shape request and the client that gets the reply
+struct daemonRequest {
+    manifestShape shape;
+    std::shared_ptr<daemonClient> client;
+};
+
+//Requests waiting for a worker
+struct daemonQueue {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<daemonRequest> pending;
+    bool closed;//No more requests, workers stop once pending is empty
+};
+
+/*Session thread of one socket connection. runDaemon joins every session before it closes the queue, so no session
+submits into a queue that is gone*/
+struct daemonConnection {
+    std::thread session;
+    std::weak_ptr<daemonClient> client;//Expired once the session and its replies are done and the socket is closed
+    std::atomic<bool> finished;//Set when the session has read its last request
+    daemonConnection() : finished(false) {}
+};
+
+/**********************Function Declarations**********************************/
+bool writeAll(int, const std::string &);//Function to write a whole string to a file descriptor
+void daemonSubmit(daemonQueue &, daemonRequest &);//Function to queue a request
+void daemonWorker(daemonQueue *, shapeResult (*)(const manifestShape &));//Function run by each worker thread
+void daemonSession(daemonQueue *, int, std::shared_ptr<daemonClient>);//Function to read the requests of one client
+void daemonReap(std::list<daemonConnection> &, bool);//Function to join the session threads that are done
+int runDaemon(const char *, unsigned, shapeResult (*)(const manifestShape &));//Function to serve shape requests until stopped
+
+//Function to write a whole string to a file descriptor. Returns false if the client has gone away
+inline bool writeAll(int fd, const std::string &text)
+{
+    size_t done = 0;
+    while(done < text.size())
+    {
+        ssize_t n = write(fd, text.data() + done, text.size() - done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+//Function to queue a request and wake up a worker. The request is moved onto the queue
+inline void daemonSubmit(daemonQueue &queue, daemonRequest &request)
+{
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.pending.push_back(std::move(request));
+    }
+    queue.ready.notify_one();
+}
+
+/*Function run by each worker thread. A worker takes one request off the queue at a time and computes it on its warm
+caches, the reply is sent as soon as the shape is done. Taking several at once would gain nothing, the caches belong to
+the thread, and would keep the ones behind a slow shape from idle workers*/
+inline void daemonWorker(daemonQueue *queue, shapeResult (*computeShape)(const manifestShape &))
+{
+    while(true)
+    {
+        daemonRequest request;
+        {
+            std::unique_lock<std::mutex> guard(queue->lock);
+            queue->ready.wait(guard, [queue]() { return !queue->pending.empty() || queue->closed; });
+            if(queue->pending.empty())//Closed and nothing left
+                return;
+            request = std::move(queue->pending.front());
+            queue->pending.pop_front();
+        }
+        std::string reply;
+        {
+            INSTRUMENT_SHAPE(request.shape.name);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            shapeResult result = computeShape(request.shape);
+            result.name = request.shape.name;
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            reply = formatResult(result);
+        }
+        std::lock_guard<std::mutex> guard(request.client->writeLock);
+        writeAll(request.client->fd, reply);
+    }
+}
+
+/*Function to read the requests of one client from inFd until quit or end of input. Malformed input(lines before the
+first shape, end without a shape) gets an error reply straight away*/
+inline void daemonSession(daemonQueue *queue, int inFd, std::shared_ptr<daemonClient> client)
+{
+    std::string buffer, text;
+    char chunk[65536];
+    int lineNumber = 0;
+    bool open = false;
+    daemonRequest request;
+    while(true)
+    {
+        size_t newline = buffer.find('\n');
+        if(newline == std::string::npos)
+        {
+            ssize_t n = read(inFd, chunk, sizeof(chunk));
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)//End of input, a last line without newline still counts
+            {
+                if(buffer.empty())
+                    break;
+                buffer += '\n';
+                continue;
+            }
+            buffer.append(chunk, (size_t)n);
+            continue;
+        }
+        text = buffer.substr(0, newline);
+        buffer.erase(0, newline + 1);
+        lineNumber++;
+        manifestLine line;
+        if(!parseManifestLine(text, lineNumber, line))
+            continue;
+        if((line.keyword == "shape" || line.keyword == "end" || line.keyword == "quit") && open)//Submit the open request
+        {
+            request.client = client;
+            daemonSubmit(*queue, request);
+            request = daemonRequest();
+            open = false;
+        }
+        else if(line.keyword == "end" || (line.keyword != "shape" && line.keyword != "quit" && !open))
+        {
+            shapeResult result;
+            result.name = "?";
+            result.ok = false;
+            result.seconds = 0.0;
+            result.error = "line " + std::to_string(lineNumber) + ": \"" + line.keyword + "\" outside a shape";
+            std::lock_guard<std::mutex> guard(client->writeLock);
+            writeAll(client->fd, formatResult(result));
+            continue;
+        }
+        if(line.keyword == "shape")
+        {
+            request.shape.name = line.rest.empty() ? "shape" + std::to_string(lineNumber) : line.rest;
+            request.shape.line = lineNumber;
+            open = true;
+        }
+        else if(line.keyword == "quit")
+            break;
+        else if(line.keyword != "end")
+            request.shape.lines.push_back(line);
+    }
+    if(open)
+    {
+        request.client = client;
+        daemonSubmit(*queue, request);
+    }
+}
+
+/*Function to join the session threads that have finished, or with stop set to end every session: reading from its
+socket is shut down so the session submits what it has and returns, replies can still be written to it*/
+inline void daemonReap(std::list<daemonConnection> &connections, bool stop)
+{
+    std::list<daemonConnection>::iterator it = connections.begin();
+    while(it != connections.end())
+    {
+        if(stop)
+        {
+            std::shared_ptr<daemonClient> client = it->client.lock();//Holds the socket open while it is shut down
+            if(client)
+                shutdown(client->fd, SHUT_RD);
+        }
+        if(stop || it->finished.load())
+        {
+            it->session.join();
+            it = connections.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+/*Function to serve shape requests with computeShape on numThreads worker threads(0 uses every core). With socketPath
+NULL the requests are read from stdin and the replies written to stdout, the daemon stops at the end of stdin once every
+request has been answered. Otherwise it listens on the Unix socket socketPath, one session per connection, until it is
+killed. If accepting a connection fails, the open sessions are ended and their requests answered before it returns.
+Returns the exit status for main*/
+inline int runDaemon(const char *socketPath, unsigned numThreads, shapeResult (*computeShape)(const manifestShape &))
+{
+    if(numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    signal(SIGPIPE, SIG_IGN);//A client that hangs up must not kill the daemon
+    daemonQueue queue;
+    queue.closed = false;
+    std::vector<std::thread> workers;
+    std::list<daemonConnection> connections;//Sessions of the socket clients
+    unsigned t;
+    for(t = 0; t < numThreads; t++)
+        workers.push_back(std::thread(daemonWorker, &queue, computeShape));
+    int status = 0;
+    if(socketPath == NULL)
+    {
+        fflush(stdout);//Replies are written straight to the file descriptor
+        daemonSession(&queue, STDIN_FILENO, std::make_shared<daemonClient>(STDOUT_FILENO));
+    }
+    else
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(strlen(socketPath) >= sizeof(address.sun_path) || listener < 0)
+        {
+            fprintf(stderr, "Error: cannot create socket %s\n", socketPath);
+            status = 1;
+        }
+        else
+        {
+            strcpy(address.sun_path, socketPath);
+            unlink(socketPath);//Left over from an earlier run
+            if(bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0)
+            {
+                fprintf(stderr, "Error: cannot listen on %s\n", socketPath);
+                status = 1;
+            }
+            while(status == 0)
+            {
+                int connection = accept(listener, NULL, NULL);
+                if(connection < 0)
+                {
+                    if(errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    fprintf(stderr, "Error: accept failed on %s\n", socketPath);
+                    status = 1;
+                    break;
+                }
+                daemonReap(connections, false);
+                connections.emplace_back();
+                daemonConnection &session = connections.back();
+                std::shared_ptr<daemonClient> client = std::make_shared<daemonClient>(connection);
+                session.client = client;
+                session.session = std::thread([&queue, &session, connection, client]()
+                {
+                    daemonSession(&queue, connection, client);
+                    session.finished.store(true);
+                });
+            }
+            daemonReap(connections, true);//Every request read so far is queued before the queue closes
+            close(listener);
+            unlink(socketPath);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.closed = true;
+    }
+    queue.ready.notify_all();
+    for(t = 0; t < workers.size(); t++)
+        workers[t].join();
+    return status;
+}
+
+#endif
@@ -0,0 +1,800 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*ExpressionTree - our own expression tree for boundary functions f(x,y). ExprTk is still used to evaluate f, this tree
+is used for everything ExprTk cannot do for us: evaluating f and both of its partial derivatives in a single
+pass(forward mode automatic differentiation), evaluating f at many points in one pass and building df/dx and df/dy as
+expressions(symbolic differentiation)*/
+
+#ifndef EXPRESSION_TREE_HPP
+#define EXPRESSION_TREE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+/*****************************Structure Definitions**************************/
+//Types of nodes in the tree
+enum nodeType {
+    NODE_CONSTANT, NODE_X, NODE_Y,//Leaves
+    NODE_ADD, NODE_SUB, NODE_MUL, NODE_DIV, NODE_MOD, NODE_POW,//Binary operators
+    NODE_NEG,//Unary minus
+    NODE_SIN, NODE_COS, NODE_TAN, NODE_ASIN, NODE_ACOS, NODE_ATAN, NODE_SINH, NODE_COSH, NODE_TANH,
+    NODE_EXP, NODE_LOG, NODE_LOG10, NODE_LOG2, NODE_SQRT, NODE_ABS, NODE_SGN,//Single argument functions
+    NODE_ATAN2, NODE_HYPOT, NODE_MIN, NODE_MAX//Two argument functions
+};
+
+/*Node of the tree. Nodes are stored in an array in postorder, so the operands of a node always come before it and the
+tree can be evaluated with a single loop over the array instead of recursion. Derivative trees share common subtrees,
+so strictly speaking they are DAGs, which the single loop handles just the same*/
+struct exprNode {
+    nodeType type;//Operation done by the node
+    double value;//Value of constant, only used if type == NODE_CONSTANT
+    int left;//Index of first operand, -1 if none
+    int right;//Index of second operand, -1 if none
+};
+
+//Expression tree for f(x,y), root is the last node
+struct exprTree {
+    std::vector<exprNode> nodes;
+};
+
+const int TREE_LANES = 8;//Points evaluated together by evalTreeBlock, every node does one loop over all of them
+
+//Operation of a treeBlock: node type and the rows holding its result and operands
+struct treeBlockOp {
+    nodeType type;
+    int result;
+    int left;
+    int right;//Same as left for single operand operations
+};
+
+/*Tree of f(x,y) prepared for evalTreeBlock. Every node has a row of TREE_LANES values: row 0 holds x and row 1 holds y of
+the points being evaluated, constants have their own rows filled in once, and only the other nodes are operations. The
+rows are overwritten by every evaluation, so a treeBlock must not be used by two threads at once*/
+struct treeBlock {
+    std::vector<treeBlockOp> ops;//Operations in postorder
+    std::vector<double> lanes;//TREE_LANES values per row
+    int root;//Row holding f(x,y)
+};
+
+//Dual number for forward mode automatic differentiation: value of f along with df/dx and df/dy
+struct dual {
+    double f;//Value
+    double fx;//df/dx
+    double fy;//df/dy
+};
+
+/**********************Function Declarations**********************************/
+bool parseTree(const std::string &, exprTree &);//Function to build the expression tree for f(x,y)
+void evalDual(const exprTree &, double, double, double[]);//Function to evaluate f, df/dx and df/dy at a point (x,y)
+void compileTreeBlock(const exprTree &, treeBlock &);//Function to prepare a tree for evalTreeBlock
+void treeBlockLanes(nodeType, double *, const double *, const double *);//Function to do one operation on all lanes
+void evalTreeBlock(treeBlock &, const double *, const double *, double *, int);//Function to evaluate f at n points
+bool diffTree(const exprTree &, nodeType, exprTree &);//Function to build the tree of df/dx or df/dy
+bool finiteConstants(const exprTree &);//Function to determine if every constant of a tree is finite
+bool treeToString(const exprTree &, std::string &);//Function to write a tree as an expression ExprTk can compile
+bool symbolicGradient(const std::string &, std::string &, std::string &);//Function to obtain df/dx and df/dy as expressions
+
+/*Recursive descent parser for the subset of the ExprTk grammar we use for boundaries: + - * / % ^, unary minus,
+implicit multiplication(2x, 2(x+1)), brackets, numbers, x, y, pi and the common math functions. Precedence and
+associativity follow ExprTk: ^ is right associative and binds tighter than unary minus, so -x^2 = -(x^2)*/
+struct exprParser {
+    const std::string &text;//Expression being parsed
+    size_t pos;//Current position in text
+    exprTree &tree;//Tree being built
+    bool ok;//Set to false on the first error
+
+    exprParser(const std::string &text1, exprTree &tree1) : text(text1), pos(0), tree(tree1), ok(true) {}
+
+    //Function to add a node to the tree, returns the index of the node
+    int add(nodeType type, int left, int right, double value)
+    {
+        exprNode node;
+        node.type = type;
+        node.value = value;
+        node.left = left;
+        node.right = right;
+        tree.nodes.push_back(node);
+        return tree.nodes.size() - 1;
+    }
+
+    //Function to skip whitespace and return the next character, '\0' at the end of the text
+    char peek()
+    {
+        while(pos < text.size() && isspace(text[pos]))
+            pos++;
+        return pos < text.size() ? text[pos] : '\0';
+    }
+
+    //expression := term (('+' | '-') term)*
+    int expression()
+    {
+        int left = term();
+        while(ok)
+        {
+            char c = peek();
+            if(c != '+' && c != '-')
+                break;
+            pos++;
+            int right = term();
+            left = add(c == '+' ? NODE_ADD : NODE_SUB, left, right, 0.0);
+        }
+        return left;
+    }
+
+    //term := unary (('*' | '/' | '%') unary | implicit multiplication)*
+    int term()
+    {
+        int left = unary();
+        while(ok)
+        {
+            char c = peek();
+            nodeType type;
+            if(c == '*')
+                type = NODE_MUL;
+            else if(c == '/')
+                type = NODE_DIV;
+            else if(c == '%')
+                type = NODE_MOD;
+            else if(c == '(' || c == '[' || c == '{' || isalpha(c) || c == '_')//2x, 2(x+1), (x)(y)
+            {
+                int right = power();
+                left = add(NODE_MUL, left, right, 0.0);
+                continue;
+            }
+            else
+                break;
+            pos++;
+            int right = unary();
+            left = add(type, left, right, 0.0);
+        }
+        return left;
+    }
+
+    //unary := ('-' | '+') unary | power
+    int unary()
+    {
+        char c = peek();
+        if(c == '-')
+        {
+            pos++;
+            return add(NODE_NEG, unary(), -1, 0.0);
+        }
+        if(c == '+')
+        {
+            pos++;
+            return unary();
+        }
+        return power();
+    }
+
+    //power := primary ('^' unary)?, right associative since the exponent is itself a unary expression
+    int power()
+    {
+        int base = primary();
+        if(ok && peek() == '^')
+        {
+            pos++;
+            int exponent = unary();
+            return add(NODE_POW, base, exponent, 0.0);
+        }
+        return base;
+    }
+
+    //primary := number | x | y | constant | function '(' arguments ')' | '(' expression ')'
+    int primary()
+    {
+        char c = peek();
+        if(c == '(' || c == '[' || c == '{')
+        {
+            char close = (c == '(') ? ')' : ((c == '[') ? ']' : '}');
+            pos++;
+            int inner = expression();
+            if(peek() != close)
+                return fail();
+            pos++;
+            return inner;
+        }
+        if(isdigit(c) || c == '.')
+        {
+            const char *begin = text.c_str() + pos;
+            char *end;
+            double value = strtod(begin, &end);
+            if(end == begin)
+                return fail();
+            pos += end - begin;
+            return add(NODE_CONSTANT, -1, -1, value);
+        }
+        if(isalpha(c) || c == '_')
+        {
+            size_t start = pos;
+            while(pos < text.size() && (isalnum(text[pos]) || text[pos] == '_'))
+                pos++;
+            std::string name = text.substr(start, pos - start);
+            if(name == "x")
+                return add(NODE_X, -1, -1, 0.0);
+            if(name == "y")
+                return add(NODE_Y, -1, -1, 0.0);
+            if(name == "pi")
+                return add(NODE_CONSTANT, -1, -1, M_PI);
+            if(name == "epsilon")
+                return add(NODE_CONSTANT, -1, -1, 0.0000000001);
+            if(name == "inf")
+                return add(NODE_CONSTANT, -1, -1, HUGE_VAL);
+            return function(name);
+        }
+        return fail();
+    }
+
+    //Function to parse the arguments of a function call, name has already been read
+    int function(const std::string &name)
+    {
+        static const char *unaryNames[] = {"sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh",
+                                           "exp", "log", "log10", "log2", "sqrt", "abs", "sgn"};
+        static const nodeType unaryTypes[] = {NODE_SIN, NODE_COS, NODE_TAN, NODE_ASIN, NODE_ACOS, NODE_ATAN, NODE_SINH,
+                                              NODE_COSH, NODE_TANH, NODE_EXP, NODE_LOG, NODE_LOG10, NODE_LOG2, NODE_SQRT, NODE_ABS,
+                                              NODE_SGN};
+        static const char *binaryNames[] = {"pow", "atan2", "hypot", "min", "max"};
+        static const nodeType binaryTypes[] = {NODE_POW, NODE_ATAN2, NODE_HYPOT, NODE_MIN, NODE_MAX};
+        if(peek() != '(')
+            return fail();
+        pos++;
+        int i;
+        for(i = 0; i < 16; i++)
+        {
+            if(name == unaryNames[i])
+            {
+                int argument = expression();
+                if(peek() != ')')
+                    return fail();
+                pos++;
+                return add(unaryTypes[i], argument, -1, 0.0);
+            }
+        }
+        for(i = 0; i < 5; i++)
+        {
+            if(name == binaryNames[i])
+            {
+                int first = expression();
+                if(peek() != ',')
+                    return fail();
+                pos++;
+                int second = expression();
+                if(peek() != ')')
+                    return fail();
+                pos++;
+                return add(binaryTypes[i], first, second, 0.0);
+            }
+        }
+        return fail();//Function we do not know how to differentiate
+    }
+
+    //Function to record a parse error
+    int fail()
+    {
+        ok = false;
+        pos = text.size();
+        return -1;
+    }
+};
+
+/*Function to build the expression tree for f(x,y). Returns false if the expression uses something the parser does not
+understand, in which case the caller should fall back to ExprTk and numerical differentiation*/
+inline bool parseTree(const std::string &function, exprTree &tree)
+{
+    tree.nodes.clear();
+    exprParser parser(function, tree);
+    parser.expression();
+    if(!parser.ok || parser.peek() != '\0' || tree.nodes.empty())
+    {
+        tree.nodes.clear();
+        return false;
+    }
+    return true;
+}
+
+/*Function to evaluate f, df/dx and df/dy at a point (a,b) with dual numbers. Every node carries its value and both partial
+derivatives, so one pass over the tree gives the exact gradient(up to rounding) without finite differences.
+result[0] = df/dx, result[1] = df/dy, result[2] = f(a,b), the same layout numericalPartialDiff uses*/
+inline void evalDual(const exprTree &tree, double a, double b, double result[])
+{
+    dual stackValues[64];//Most boundaries are small, only allocate for large trees
+    std::vector<dual> heapValues;
+    dual *v = stackValues;
+    if(tree.nodes.size() > 64)
+    {
+        heapValues.resize(tree.nodes.size());
+        v = &heapValues[0];
+    }
+    size_t i;
+    for(i = 0; i < tree.nodes.size(); i++)
+    {
+        const exprNode &node = tree.nodes[i];
+        dual &r = v[i];
+        const dual &p = v[node.left < 0 ? i : node.left];//Operands, only meaningful for nodes that have them
+        const dual &q = v[node.right < 0 ? i : node.right];
+        double d;//Derivative of the outer function for single argument functions(chain rule)
+        switch(node.type)
+        {
+            case NODE_CONSTANT: r.f = node.value; r.fx = 0.0; r.fy = 0.0; continue;
+            case NODE_X: r.f = a; r.fx = 1.0; r.fy = 0.0; continue;
+            case NODE_Y: r.f = b; r.fx = 0.0; r.fy = 1.0; continue;
+            case NODE_ADD: r.f = p.f + q.f; r.fx = p.fx + q.fx; r.fy = p.fy + q.fy; continue;
+            case NODE_SUB: r.f = p.f - q.f; r.fx = p.fx - q.fx; r.fy = p.fy - q.fy; continue;
+            case NODE_NEG: r.f = -p.f; r.fx = -p.fx; r.fy = -p.fy; continue;
+            case NODE_MUL:
+                r.fx = p.fx * q.f + p.f * q.fx;
+                r.fy = p.fy * q.f + p.f * q.fy;
+                r.f = p.f * q.f;
+                continue;
+            case NODE_DIV:
+                r.f = p.f / q.f;
+                r.fx = (p.fx - r.f * q.fx) / q.f;
+                r.fy = (p.fy - r.f * q.fy) / q.f;
+                continue;
+            case NODE_MOD://a - trunc(a/b) * b, trunc is piecewise constant
+            {
+                double t = trunc(p.f / q.f);
+                r.f = fmod(p.f, q.f);
+                r.fx = p.fx - t * q.fx;
+                r.fy = p.fy - t * q.fy;
+                continue;
+            }
+            case NODE_POW:
+                r.f = pow(p.f, q.f);
+                if(q.fx == 0.0 && q.fy == 0.0)//Constant exponent, also valid for negative bases
+                {
+                    d = (q.f == 0.0) ? 0.0 : q.f * pow(p.f, q.f - 1.0);
+                    r.fx = d * p.fx;
+                    r.fy = d * p.fy;
+                }
+                else//(a^b)' = a^b * (b' ln(a) + b a'/a)
+                {
+                    double lnA = log(p.f);
+                    r.fx = r.f * (q.fx * lnA + q.f * p.fx / p.f);
+                    r.fy = r.f * (q.fy * lnA + q.f * p.fy / p.f);
+                }
+                continue;
+            case NODE_ATAN2://atan2(a,b)' = (b a' - a b') / (a^2 + b^2)
+                d = p.f * p.f + q.f * q.f;
+                r.f = atan2(p.f, q.f);
+                r.fx = (q.f * p.fx - p.f * q.fx) / d;
+                r.fy = (q.f * p.fy - p.f * q.fy) / d;
+                continue;
+            case NODE_HYPOT:
+                r.f = hypot(p.f, q.f);
+                r.fx = (p.f * p.fx + q.f * q.fx) / r.f;
+                r.fy = (p.f * p.fy + q.f * q.fy) / r.f;
+                continue;
+            case NODE_MIN:
+                r = (p.f <= q.f) ? p : q;
+                continue;
+            case NODE_MAX:
+                r = (p.f >= q.f) ? p : q;
+                continue;
+            case NODE_SIN: r.f = sin(p.f); d = cos(p.f); break;
+            case NODE_COS: r.f = cos(p.f); d = -sin(p.f); break;
+            case NODE_TAN: r.f = tan(p.f); d = 1.0 + r.f * r.f; break;
+            case NODE_ASIN: r.f = asin(p.f); d = 1.0 / sqrt(1.0 - p.f * p.f); break;
+            case NODE_ACOS: r.f = acos(p.f); d = -1.0 / sqrt(1.0 - p.f * p.f); break;
+            case NODE_ATAN: r.f = atan(p.f); d = 1.0 / (1.0 + p.f * p.f); break;
+            case NODE_SINH: r.f = sinh(p.f); d = cosh(p.f); break;
+            case NODE_COSH: r.f = cosh(p.f); d = sinh(p.f); break;
+            case NODE_TANH: r.f = tanh(p.f); d = 1.0 - r.f * r.f; break;
+            case NODE_EXP: r.f = exp(p.f); d = r.f; break;
+            case NODE_LOG: r.f = log(p.f); d = 1.0 / p.f; break;
+            case NODE_LOG10: r.f = log10(p.f); d = 1.0 / (p.f * M_LN10); break;
+            case NODE_LOG2: r.f = log2(p.f); d = 1.0 / (p.f * M_LN2); break;
+            case NODE_SQRT: r.f = sqrt(p.f); d = 0.5 / r.f; break;
+            case NODE_ABS: r.f = fabs(p.f); d = (p.f < 0.0) ? -1.0 : 1.0; break;
+            case NODE_SGN: r.f = (p.f > 0.0) ? 1.0 : ((p.f < 0.0) ? -1.0 : 0.0); d = 0.0; break;
+            default: r.f = NAN; d = NAN; break;
+        }
+        r.fx = d * p.fx;//Chain rule for single argument functions
+        r.fy = d * p.fy;
+    }
+    const dual &root = v[tree.nodes.size() - 1];
+    result[0] = root.fx;
+    result[1] = root.fy;
+    result[2] = root.f;
+}
+
+//Function to prepare a tree for evalTreeBlock: give every node its row, fill in the constants and list the operations
+inline void compileTreeBlock(const exprTree &tree, treeBlock &block)
+{
+    std::vector<int> row(tree.nodes.size());
+    int rows = 2;//Rows 0 and 1 are x and y
+    size_t i;
+    block.ops.clear();
+    block.lanes.clear();
+    for(i = 0; i < tree.nodes.size(); i++)
+    {
+        const exprNode &node = tree.nodes[i];
+        if(node.type == NODE_X || node.type == NODE_Y)
+        {
+            row[i] = (node.type == NODE_X) ? 0 : 1;
+            continue;
+        }
+        row[i] = rows++;
+        if(node.type == NODE_CONSTANT)
+            continue;
+        treeBlockOp op;
+        op.type = node.type;
+        op.result = row[i];
+        op.left = row[node.left];
+        op.right = row[node.right < 0 ? node.left : node.right];
+        block.ops.push_back(op);
+    }
+    block.lanes.assign((size_t)rows * TREE_LANES, 0.0);
+    for(i = 0; i < tree.nodes.size(); i++)
+        if(tree.nodes[i].type == NODE_CONSTANT)
+            std::fill(block.lanes.begin() + row[i] * TREE_LANES, block.lanes.begin() + (row[i] + 1) * TREE_LANES, tree.nodes[i].value);
+    block.root = tree.nodes.empty() ? 0 : row[tree.nodes.size() - 1];
+}
+
+/*Function to do one operation of a treeBlock on all TREE_LANES points: r = type(p, q). The operands come before the
+operation, so they never overlap r and the loops are vectorized without aliasing checks*/
+inline void treeBlockLanes(nodeType type, double *__restrict r, const double *__restrict p, const double *__restrict q)
+{
+    int k;
+#define TREE_LANE_LOOP(value) for(k = 0; k < TREE_LANES; k++) r[k] = (value); return
+    switch(type)
+    {
+        case NODE_ADD: TREE_LANE_LOOP(p[k] + q[k]);
+        case NODE_SUB: TREE_LANE_LOOP(p[k] - q[k]);
+        case NODE_MUL: TREE_LANE_LOOP(p[k] * q[k]);
+        case NODE_DIV: TREE_LANE_LOOP(p[k] / q[k]);
+        case NODE_MOD: TREE_LANE_LOOP(fmod(p[k], q[k]));
+        case NODE_POW: TREE_LANE_LOOP(pow(p[k], q[k]));
+        case NODE_NEG: TREE_LANE_LOOP(-p[k]);
+        case NODE_SIN: TREE_LANE_LOOP(sin(p[k]));
+        case NODE_COS: TREE_LANE_LOOP(cos(p[k]));
+        case NODE_TAN: TREE_LANE_LOOP(tan(p[k]));
+        case NODE_ASIN: TREE_LANE_LOOP(asin(p[k]));
+        case NODE_ACOS: TREE_LANE_LOOP(acos(p[k]));
+        case NODE_ATAN: TREE_LANE_LOOP(atan(p[k]));
+        case NODE_SINH: TREE_LANE_LOOP(sinh(p[k]));
+        case NODE_COSH: TREE_LANE_LOOP(cosh(p[k]));
+        case NODE_TANH: TREE_LANE_LOOP(tanh(p[k]));
+        case NODE_EXP: TREE_LANE_LOOP(exp(p[k]));
+        case NODE_LOG: TREE_LANE_LOOP(log(p[k]));
+        case NODE_LOG10: TREE_LANE_LOOP(log10(p[k]));
+        case NODE_LOG2: TREE_LANE_LOOP(log2(p[k]));
+        case NODE_SQRT: TREE_LANE_LOOP(sqrt(p[k]));
+        case NODE_ABS: TREE_LANE_LOOP(fabs(p[k]));
+        case NODE_SGN: TREE_LANE_LOOP((p[k] > 0.0) ? 1.0 : ((p[k] < 0.0) ? -1.0 : 0.0));
+        case NODE_ATAN2: TREE_LANE_LOOP(atan2(p[k], q[k]));
+        case NODE_HYPOT: TREE_LANE_LOOP(hypot(p[k], q[k]));
+        case NODE_MIN: TREE_LANE_LOOP((p[k] <= q[k]) ? p[k] : q[k]);
+        case NODE_MAX: TREE_LANE_LOOP((p[k] >= q[k]) ? p[k] : q[k]);
+        default: TREE_LANE_LOOP(NAN);
+    }
+#undef TREE_LANE_LOOP
+}
+
+/*Function to evaluate f at the n points (xs[i],ys[i]) and store the values in results. The points go through the
+operations TREE_LANES at a time with the values of each node stored side by side(structure of arrays), so each operation
+is dispatched once per TREE_LANES points and its loop over the points is vectorized by the compiler. Gives the same values
+as the f part of evalDual*/
+inline void evalTreeBlock(treeBlock &block, const double *xs, const double *ys, double *results, int n)
+{
+    double *v = &block.lanes[0];
+    size_t i;
+    int first, k;
+    for(first = 0; first < n; first += TREE_LANES)
+    {
+        int count = std::min(TREE_LANES, n - first);
+        for(k = 0; k < TREE_LANES; k++)//Unused lanes repeat the first point
+        {
+            v[k] = xs[first + (k < count ? k : 0)];
+            v[TREE_LANES + k] = ys[first + (k < count ? k : 0)];
+        }
+        for(i = 0; i < block.ops.size(); i++)
+        {
+            const treeBlockOp &op = block.ops[i];
+            treeBlockLanes(op.type, v + op.result * TREE_LANES, v + op.left * TREE_LANES, v + op.right * TREE_LANES);
+        }
+        const double *root = v + block.root * TREE_LANES;
+        for(k = 0; k < count; k++)
+            results[first + k] = root[k];
+    }
+}
+
+/*Symbolic differentiation. diffTree builds the tree of df/dx or df/dy from the tree of f, simplifying as it goes
+(constant folding, x+0, x*1, x*0, x^1...) so gradients of the usual polynomial boundaries stay as small as written
+by hand. Nodes of f are copied at most once and derivatives of shared nodes are computed at most once*/
+struct exprDiffer {
+    const exprTree &src;//Tree of f
+    nodeType var;//NODE_X or NODE_Y
+    exprTree &dst;//Tree of the derivative
+    std::vector<int> copied;//Index in dst of each node of src, -1 if not copied yet
+    std::vector<int> derived;//Index in dst of the derivative of each node of src, -1 if not computed yet
+    std::vector<bool> variable;//True if the node of src depends on x or y
+    bool ok;//Set to false if f uses something we cannot differentiate symbolically
+
+    exprDiffer(const exprTree &src1, nodeType var1, exprTree &dst1) : src(src1), var(var1), dst(dst1),
+        copied(src1.nodes.size(), -1), derived(src1.nodes.size(), -1), variable(src1.nodes.size(), false), ok(true)
+    {
+        size_t i;
+        for(i = 0; i < src.nodes.size(); i++)
+        {
+            const exprNode &node = src.nodes[i];
+            variable[i] = node.type == NODE_X || node.type == NODE_Y || (node.left >= 0 && variable[node.left]) ||
+                          (node.right >= 0 && variable[node.right]);
+        }
+    }
+
+    //Function to determine if node n of dst is the constant c
+    bool isConstant(int n, double c)
+    {
+        return dst.nodes[n].type == NODE_CONSTANT && dst.nodes[n].value == c;
+    }
+
+    //Function to add a node to dst, returns the index of the node
+    int add(nodeType type, int left, int right, double value)
+    {
+        exprNode node;
+        node.type = type;
+        node.value = value;
+        node.left = left;
+        node.right = right;
+        dst.nodes.push_back(node);
+        return dst.nodes.size() - 1;
+    }
+
+    int constant(double value)
+    {
+        return add(NODE_CONSTANT, -1, -1, value);
+    }
+
+    //Function to add an operation to dst, folding constants and removing identities
+    int make(nodeType type, int a, int b)
+    {
+        bool constA = dst.nodes[a].type == NODE_CONSTANT;
+        bool constB = b >= 0 && dst.nodes[b].type == NODE_CONSTANT;
+        if(constA && (b < 0 || constB))//Fold by evaluating the single node
+        {
+            exprTree single;
+            single.nodes.push_back(dst.nodes[a]);
+            single.nodes.back().left = single.nodes.back().right = -1;
+            int operand2 = -1;
+            if(b >= 0)
+            {
+                single.nodes.push_back(dst.nodes[b]);
+                single.nodes.back().left = single.nodes.back().right = -1;
+                operand2 = 1;
+            }
+            exprNode node;
+            node.type = type;
+            node.value = 0.0;
+            node.left = 0;
+            node.right = operand2;
+            single.nodes.push_back(node);
+            double result[3];
+            evalDual(single, 0.0, 0.0, result);
+            return constant(result[2]);
+        }
+        switch(type)
+        {
+            case NODE_ADD:
+                if(isConstant(a, 0.0)) return b;
+                if(isConstant(b, 0.0)) return a;
+                break;
+            case NODE_SUB:
+                if(isConstant(b, 0.0)) return a;
+                if(isConstant(a, 0.0)) return make(NODE_NEG, b, -1);
+                break;
+            case NODE_MUL:
+                if(isConstant(a, 0.0) || isConstant(b, 0.0)) return constant(0.0);
+                if(isConstant(a, 1.0)) return b;
+                if(isConstant(b, 1.0)) return a;
+                if(isConstant(a, -1.0)) return make(NODE_NEG, b, -1);
+                if(isConstant(b, -1.0)) return make(NODE_NEG, a, -1);
+                break;
+            case NODE_DIV:
+                if(isConstant(a, 0.0)) return constant(0.0);
+                if(isConstant(b, 1.0)) return a;
+                break;
+            case NODE_POW:
+                if(isConstant(b, 1.0)) return a;
+                if(isConstant(b, 0.0)) return constant(1.0);
+                break;
+            case NODE_NEG:
+                if(dst.nodes[a].type == NODE_NEG) return dst.nodes[a].left;
+                break;
+            default:
+                break;
+        }
+        return add(type, a, b, 0.0);
+    }
+
+    //Function to copy node n of src(and its operands) into dst
+    int copy(int n)
+    {
+        if(copied[n] >= 0)
+            return copied[n];
+        const exprNode &node = src.nodes[n];
+        int result;
+        if(node.left < 0)
+            result = add(node.type, -1, -1, node.value);
+        else
+            result = make(node.type, copy(node.left), node.right >= 0 ? copy(node.right) : -1);
+        copied[n] = result;
+        return result;
+    }
+
+    //Function to build the derivative of node n of src in dst
+    int derive(int n)
+    {
+        if(derived[n] >= 0)
+            return derived[n];
+        if(!variable[n])//Constants and constant subtrees
+            return derived[n] = constant(0.0);
+        const exprNode &node = src.nodes[n];
+        if(node.type == NODE_X || node.type == NODE_Y)
+            return derived[n] = constant(node.type == var ? 1.0 : 0.0);
+        int p = copy(node.left);
+        int dp = derive(node.left);
+        int q = -1, dq = -1;
+        if(node.right >= 0)
+        {
+            q = copy(node.right);
+            dq = derive(node.right);
+        }
+        int d;//Derivative of the outer function for single argument functions(chain rule)
+        int result;
+        switch(node.type)
+        {
+            case NODE_ADD: result = make(NODE_ADD, dp, dq); break;
+            case NODE_SUB: result = make(NODE_SUB, dp, dq); break;
+            case NODE_NEG: result = make(NODE_NEG, dp, -1); break;
+            case NODE_MUL: result = make(NODE_ADD, make(NODE_MUL, dp, q), make(NODE_MUL, p, dq)); break;
+            case NODE_DIV://(p'q - pq') / q^2
+                if(isConstant(dq, 0.0))//Constant denominator: p'/q
+                    result = make(NODE_DIV, dp, q);
+                else
+                    result = make(NODE_DIV, make(NODE_SUB, make(NODE_MUL, dp, q), make(NODE_MUL, p, dq)), make(NODE_MUL, q, q));
+                break;
+            case NODE_MOD:
+                if(variable[node.right])//trunc(p/q) has no node type
+                {
+                    ok = false;
+                    return derived[n] = constant(0.0);
+                }
+                result = dp;
+                break;
+            case NODE_POW:
+                if(!variable[node.right])//Constant exponent: q p^(q-1) p'
+                    result = make(NODE_MUL, make(NODE_MUL, q, make(NODE_POW, p, make(NODE_SUB, q, constant(1.0)))), dp);
+                else//p^q (q' ln(p) + q p'/p)
+                    result = make(NODE_MUL, make(NODE_POW, p, q), make(NODE_ADD, make(NODE_MUL, dq, make(NODE_LOG, p, -1)),
+                                  make(NODE_DIV, make(NODE_MUL, q, dp), p)));
+                break;
+            case NODE_ATAN2://(q p' - p q') / (p^2 + q^2)
+                result = make(NODE_DIV, make(NODE_SUB, make(NODE_MUL, q, dp), make(NODE_MUL, p, dq)),
+                              make(NODE_ADD, make(NODE_MUL, p, p), make(NODE_MUL, q, q)));
+                break;
+            case NODE_HYPOT://(p p' + q q') / hypot(p,q)
+                result = make(NODE_DIV, make(NODE_ADD, make(NODE_MUL, p, dp), make(NODE_MUL, q, dq)), make(NODE_HYPOT, p, q));
+                break;
+            case NODE_MIN: case NODE_MAX://Piecewise, no conditional node type
+                ok = false;
+                return derived[n] = constant(0.0);
+            default:
+                switch(node.type)
+                {
+                    case NODE_SIN: d = make(NODE_COS, p, -1); break;
+                    case NODE_COS: d = make(NODE_NEG, make(NODE_SIN, p, -1), -1); break;
+                    case NODE_TAN: d = make(NODE_ADD, constant(1.0), make(NODE_POW, make(NODE_TAN, p, -1), constant(2.0))); break;
+                    case NODE_ASIN: d = make(NODE_DIV, constant(1.0), make(NODE_SQRT, make(NODE_SUB, constant(1.0), make(NODE_MUL, p, p)), -1)); break;
+                    case NODE_ACOS: d = make(NODE_DIV, constant(-1.0), make(NODE_SQRT, make(NODE_SUB, constant(1.0), make(NODE_MUL, p, p)), -1)); break;
+                    case NODE_ATAN: d = make(NODE_DIV, constant(1.0), make(NODE_ADD, constant(1.0), make(NODE_MUL, p, p))); break;
+                    case NODE_SINH: d = make(NODE_COSH, p, -1); break;
+                    case NODE_COSH: d = make(NODE_SINH, p, -1); break;
+                    case NODE_TANH: d = make(NODE_SUB, constant(1.0), make(NODE_POW, make(NODE_TANH, p, -1), constant(2.0))); break;
+                    case NODE_EXP: d = copy(n); break;
+                    case NODE_LOG: d = make(NODE_DIV, constant(1.0), p); break;
+                    case NODE_LOG10: d = make(NODE_DIV, constant(1.0), make(NODE_MUL, p, constant(M_LN10))); break;
+                    case NODE_LOG2: d = make(NODE_DIV, constant(1.0), make(NODE_MUL, p, constant(M_LN2))); break;
+                    case NODE_SQRT: d = make(NODE_DIV, constant(0.5), copy(n)); break;
+                    case NODE_ABS: d = make(NODE_SGN, p, -1); break;
+                    default: d = constant(0.0); break;//sgn
+                }
+                result = make(NODE_MUL, d, dp);
+                break;
+        }
+        return derived[n] = result;
+    }
+};
+
+//Function to determine if every constant of a tree is finite, folding can turn acos(2) into nan or 1/0 into inf
+inline bool finiteConstants(const exprTree &tree)
+{
+    size_t i;
+    for(i = 0; i < tree.nodes.size(); i++)
+    {
+        if(tree.nodes[i].type == NODE_CONSTANT && !std::isfinite(tree.nodes[i].value))
+            return false;
+    }
+    return true;
+}
+
+/*Function to build the tree of df/dx(var = NODE_X) or df/dy(var = NODE_Y), returns false if f cannot be differentiated
+symbolically or a constant of the derivative is not finite*/
+inline bool diffTree(const exprTree &tree, nodeType var, exprTree &derivative)
+{
+    derivative.nodes.clear();
+    if(tree.nodes.empty())
+        return false;
+    exprDiffer differ(tree, var, derivative);
+    int root = differ.derive(tree.nodes.size() - 1);
+    if(!differ.ok || !finiteConstants(derivative))
+    {
+        derivative.nodes.clear();
+        return false;
+    }
+    if(root != (int)derivative.nodes.size() - 1)//Root must be the last node, re-add it if it was reused
+    {
+        exprNode node = derivative.nodes[root];
+        derivative.nodes.push_back(node);
+    }
+    return true;
+}
+
+/*Function to write node n of a tree as an ExprTk expression, every operation is parenthesized. Constants must be finite
+(see finiteConstants), ExprTk has no literal for nan*/
+inline std::string nodeToString(const exprTree &tree, int n)
+{
+    static const char *functionNames[] = {"sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh",
+                                          "exp", "log", "log10", "log2", "sqrt", "abs", "sgn"};
+    const exprNode &node = tree.nodes[n];
+    switch(node.type)
+    {
+        case NODE_CONSTANT:
+        {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), node.value < 0 ? "(%.17g)" : "%.17g", node.value);
+            return buffer;
+        }
+        case NODE_X: return "x";
+        case NODE_Y: return "y";
+        case NODE_ADD: return "(" + nodeToString(tree, node.left) + "+" + nodeToString(tree, node.right) + ")";
+        case NODE_SUB: return "(" + nodeToString(tree, node.left) + "-" + nodeToString(tree, node.right) + ")";
+        case NODE_MUL: return "(" + nodeToString(tree, node.left) + "*" + nodeToString(tree, node.right) + ")";
+        case NODE_DIV: return "(" + nodeToString(tree, node.left) + "/" + nodeToString(tree, node.right) + ")";
+        case NODE_MOD: return "(" + nodeToString(tree, node.left) + "%" + nodeToString(tree, node.right) + ")";
+        case NODE_POW: return "(" + nodeToString(tree, node.left) + "^" + nodeToString(tree, node.right) + ")";
+        case NODE_NEG: return "(-" + nodeToString(tree, node.left) + ")";
+        case NODE_ATAN2: return "atan2(" + nodeToString(tree, node.left) + "," + nodeToString(tree, node.right) + ")";
+        case NODE_HYPOT: return "hypot(" + nodeToString(tree, node.left) + "," + nodeToString(tree, node.right) + ")";
+        case NODE_MIN: return "min(" + nodeToString(tree, node.left) + "," + nodeToString(tree, node.right) + ")";
+        case NODE_MAX: return "max(" + nodeToString(tree, node.left) + "," + nodeToString(tree, node.right) + ")";
+        default: return std::string(functionNames[node.type - NODE_SIN]) + "(" + nodeToString(tree, node.left) + ")";
+    }
+}
+
+//Function to write a tree as an expression ExprTk can compile, returns false if the tree has a constant that is not finite
+inline bool treeToString(const exprTree &tree, std::string &text)
+{
+    if(tree.nodes.empty() || !finiteConstants(tree))
+        return false;
+    text = nodeToString(tree, tree.nodes.size() - 1);
+    return true;
+}
+
+//Function to obtain df/dx and df/dy of f(x,y) as expression strings, returns false if f cannot be differentiated symbolically
+inline bool symbolicGradient(const std::string &function, std::string &dfdx, std::string &dfdy)
+{
+    exprTree tree, treeX, treeY;
+    return parseTree(function, tree) && diffTree(tree, NODE_X, treeX) && diffTree(tree, NODE_Y, treeY) &&
+           treeToString(treeX, dfdx) && treeToString(treeY, dfdy);
+}
+
+#endif
@@ -0,0 +1,727 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Greens - the Hyades boundary traversal as a reentrant library. Everything a traversal reads or writes(step size and
+search grid, visited index, ExprTk parser, symbol tables and compiled expressions, block buffers, derivatives, running
+area and boundary points) is owned by a greensContext, and every function takes the context it works on. Any number of
+contexts can compute shapes at the same time in one process without locks, as long as each context is used by one
+thread at a time. The symbol tables are bound to variables inside the context, so a context must not be copied or moved
+once it has been used.
+Cygnus traces with its own predictor-corrector but compiles, evaluates and differentiates through a greensContext too.
+Nothing here ends the process: a function string ExprTk cannot compile or a traversal that gets stuck is reported as a
+greensStatus, with the message in the context's error.
+    greensContext context;
+    double area;
+    if(greensShape(context, segments, area) != GREENS_OK)
+        printf("%s\n", context.error.c_str());*/
+
+#ifndef GREENS_HPP
+#define GREENS_HPP
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include "exprtk.hpp"
+#include "PolygonArea.h"
+#include "ExpressionTree.hpp"
+#include "Instrument.hpp"
+#include "TraceSink.hpp"
+#include "NativeKernel.hpp"
+
+/*****************************Structure Definitions**************************/
+//Point structure for a point (x,y)
+struct greensPoint {
+    double x;//x-coordinate
+    double y;//y-coordinate
+};
+
+/*One segment of the boundary: f(x,y) = 0 from start to end, within the minimum and maximum x- and y- coordinates for
+which the function is defined*/
+struct greensSegment {
+    std::string function;//f(x,y) that forms boundary of shape
+    greensPoint start;//Starting point of traversal
+    greensPoint end;//End point of traversal. For a closed loop, start = end
+    double xmin;//Min. x-coordinate of function
+    double xmax;//Max. x-coordinate of function
+    double ymin;//Min. y-coordinate of function
+    double ymax;//Max. y-coordinate of function
+};
+
+//Outcome of a library call
+enum greensStatus {
+    GREENS_OK,
+    GREENS_BAD_FUNCTION,//ExprTk cannot compile a function string
+    GREENS_NO_SEGMENTS,//Shape without segments
+    GREENS_STUCK//Every neighbour of a point is visited or out of bounds before the end of the segment was reached
+};
+
+//Type definitions from ExprTk library
+typedef exprtk::symbol_table<double> symbol_table_t;
+typedef exprtk::expression<double> expression_t;
+typedef exprtk::parser<double> parser_t;
+
+/*Index of visited points. Every point the traversal visits lies on the lattice of spacing delta, so a point is identified
+exactly by its integer grid coordinates (round(x/delta), round(y/delta)) and no epsilon comparisons are needed. Search
+regions of up to GREENS_DENSE_LIMIT grid cells use a dense bitset over the xmin..xmax, ymin..ymax grid, larger ones a flat
+open addressing hash table of the packed grid coordinates. Every 64 bit value is the key of some grid point, so whether a
+slot is empty, holds a key or was erased is kept in a separate state byte*/
+const long long GREENS_DENSE_LIMIT = 1LL << 26;//Max number of cells(bits) of the dense bitset, 8MB
+const unsigned char GREENS_EMPTY_SLOT = 0;//Slot of the hash table that was never used
+const unsigned char GREENS_USED_SLOT = 1;//Slot of the hash table that holds a key
+const unsigned char GREENS_ERASED_SLOT = 2;//Slot of the hash table whose key was erased
+struct visitedIndex {
+    bool dense;//True if the bitset is used, false if the hash table is used
+    long long imin, jmin, width, height;//Grid covered by the bitset
+    std::vector<unsigned long long> bits;//Dense bitset, bit (i - imin) * height + (j - jmin)
+    std::vector<unsigned long long> table;//Hash table of packed grid coordinates, size is a power of 2
+    std::vector<unsigned char> state;//State of each slot of the hash table
+    size_t used;//Number of slots of the hash table that are not empty(keys and erased keys)
+};
+
+/*Block evaluation. A function our expression tree can parse is evaluated over the block by evalTreeBlock(see
+ExpressionTree.hpp), one pass over its operations for TREE_LANES points. Any other function that only uses element-wise
+operations is compiled as "fBlock := f(x,y)" with x and y bound to the block buffers, so ExprTk evaluates the whole block
+in a single pass over its expression tree*/
+const int GREENS_BLOCK_SIZE = 8;//Number of points evaluated in one pass by the vector form
+struct blockExpression {
+    bool parsed;//True if f(x,y) is evaluated over its expression tree
+    treeBlock tree;//Expression tree of f(x,y) prepared for evalTreeBlock, only valid if parsed
+    bool vectorized;//True if f(x,y) could be compiled over the block buffers
+    expression_t expression;//Vector form of f(x,y), only valid if vectorized
+};
+
+//How the partial derivatives of a function are calculated, from fastest to slowest
+enum diffMethod {
+    DIFF_SYMBOLIC,//Compiled expressions for df/dx and df/dy
+    DIFF_DUAL,//One dual number pass over the expression tree(piecewise functions such as min and max)
+    DIFF_NUMERICAL//Central differences(functions the expression tree cannot parse)
+};
+struct derivativeStruct {
+    diffMethod method;
+    expression_t f;//Compiled f(x,y)
+    expression_t dfdx;//Compiled df/dx, only for DIFF_SYMBOLIC
+    expression_t dfdy;//Compiled df/dy, only for DIFF_SYMBOLIC
+    exprTree tree;//Expression tree of f(x,y), only for DIFF_DUAL
+    nativeKernel *native;//Compiled kernel of f(x,y) if native kernels are on(see NativeKernel.hpp)
+    bool useNative;//partialDiff uses native over method, decided by greensLatch when a trace starts
+    derivativeStruct() : method(DIFF_NUMERICAL), native(NULL), useNative(false) {}
+};
+
+//Everything one traversal works on
+struct greensContext {
+    double delta;//Step size, change with greensSetStep
+    double h;//Needed for numerical differentiation
+    double xc[8], yc[8];//Search grid. Search order: up, down, left, right, upper left, lower right, upper right, lower left
+    bool storePoints;//Set to keep the boundary points in points, otherwise only the running area is kept
+    bool tracePoints;//Record every point in the trace sink(see TraceSink.hpp) as it is found
+    uint64_t tracePath;//Trace path of the segment being traced
+    std::vector<greensPoint> points;//Boundary points in order, only filled if storePoints is set
+    areaAccumulator area;//Area accumulated edge by edge as the traversal goes
+    visitedIndex visited;//Visited points of the current segment
+    parser_t parser;
+    symbol_table_t symbolTable;//Shared by every compiled expression, binds x and y to xVar and yVar
+    double xVar, yVar;//Variables read by the compiled expressions
+    std::unordered_map<std::string, expression_t> expressionCache;//Each function string is compiled exactly once
+    double xBlock[GREENS_BLOCK_SIZE], yBlock[GREENS_BLOCK_SIZE], fBlock[GREENS_BLOCK_SIZE];//Block buffers read/written by the vector expressions
+    symbol_table_t blockSymbolTable;//Binds x, y and fBlock to the block buffers
+    std::unordered_map<std::string, blockExpression> blockCache;//Vector form of each function string, compiled once
+    std::unordered_map<std::string, derivativeStruct> derivativeCache;//Derivatives of each function string, set up once
+    std::string error;//What went wrong in the last call that did not return GREENS_OK
+    greensContext();
+    greensContext(const greensContext &) = delete;//The symbol tables point into the context
+    greensContext &operator=(const greensContext &) = delete;
+};
+
+/**********************Function Declarations**********************************/
+void greensSetStep(greensContext &, double);//Function to set the step size and search grid
+long long gridCoord(const greensContext &, double);//Function to obtain the grid coordinate of an x- or y-coordinate
+unsigned long long gridKey(const greensContext &, greensPoint);//Function to pack the grid coordinates of a point into one key
+void initVisited(greensContext &, const std::vector<greensSegment> &);//Function to set up the visited index for a set of boundary segments
+bool isVisited(const greensContext &, greensPoint);//Function to determine if a point has been visited
+void markVisited(greensContext &, greensPoint, bool);//Function to mark a point as visited or not visited
+void growTable(greensContext &);//Function to double the size of the visited hash table
+void addPoint(greensContext &, greensPoint);//Function to add the next boundary point to the running area
+greensStatus dfs(greensContext &, const greensSegment &);//Function to obtain points along boundary of shape
+greensStatus greensTraceSegment(greensContext &, const greensSegment &);//Function to trace one segment
+greensStatus greensShape(greensContext &, const std::vector<greensSegment> &, double &);//Function to calculate the area of a shape
+bool blackBirdN(greensContext &, greensPoint, const greensSegment &, greensPoint &);//Function to determine the next point in the search
+int inBounds(greensPoint, const greensSegment &);//Function to determine if a point is within the overall boundaries of the search
+greensStatus greensCompile(greensContext &, const std::string &);//Function to compile f(x,y) and set up its derivatives
+expression_t *getExpression(greensContext &, const std::string &);//Function to obtain the compiled expression for f(x,y)
+double eval(greensContext &, const std::string &, double, double);//Function to evaluate the function at a point (x,y)
+bool isElementWise(const std::string &);//Function to determine if f(x,y) can be evaluated over a block of points at once
+blockExpression &getBlockExpression(greensContext &, const std::string &);//Function to obtain the vector form of f(x,y)
+void evalBlock(greensContext &, const std::string &, const double *, const double *, double *, int);//Function to evaluate f(x,y) at n points
+derivativeStruct *getDerivatives(greensContext &, const std::string &);//Function to obtain the derivatives of f(x,y)
+void greensLatch(greensContext &, const std::string &);//Function to fix how partialDiff differentiates f(x,y) for one trace
+void partialDiff(greensContext &, const std::string &, double, double, double[]);//Function to calculate the partial derivatives of a two-variable function f(x,y)
+void numericalPartialDiff(greensContext &, const std::string &, double, double, double[]);//Function to numerically calculate the partial derivatives a two-variable function f(x,y)
+double calcArea(const std::vector<greensPoint> &);//Function to calculate area
+
+//Function to set up a context with the default step size
+inline greensContext::greensContext() : h(0.0000001), storePoints(false), tracePoints(false), tracePath(0), xVar(0.0), yVar(0.0)
+{
+    greensSetStep(*this, 0.05);
+    areaInit(&area);
+    visited.dense = false;
+    visited.used = 0;
+}
+
+//Function to set the step size, the search grid is the 8 neighbours at distance delta
+inline void greensSetStep(greensContext &ctx, double delta)
+{
+    const double xs[] = {0, 0, -1, 1, -1, 1, 1, -1};
+    const double ys[] = {1, -1, 0, 0, 1, -1, 1, -1};
+    ctx.delta = delta;
+    int i;
+    for(i = 0; i < 8; i++)
+    {
+        ctx.xc[i] = xs[i] * delta;
+        ctx.yc[i] = ys[i] * delta;
+    }
+}
+
+/*Function to add the next boundary point to the running area, to points if the caller wants the boundary and to the trace
+if it is being recorded*/
+inline void addPoint(greensContext &ctx, greensPoint p)
+{
+    areaAddVertex(&ctx.area, p.x, p.y);
+    if(ctx.storePoints)
+        ctx.points.push_back(p);
+    if(ctx.tracePoints)
+        tracePoint(ctx.tracePath, p.x, p.y);
+}
+
+/*
+Given function f(x,y) = 0 for boundary(or segment of boundary of shape), obtain
+points (x,y) along boundary of shape and feed each new edge to the running area in ctx.area.
+*/
+inline greensStatus dfs(greensContext &ctx, const greensSegment &fs1)
+{
+    greensPoint curPoint, end, next;
+    curPoint = fs1.start;
+    end = fs1.end;
+    addPoint(ctx, curPoint);//Adding starting and first points
+    markVisited(ctx, curPoint, true);
+    if(!blackBirdN(ctx, curPoint, fs1, next))
+        return GREENS_STUCK;
+    INSTRUMENT_COUNT(STEPS, 1);
+    curPoint = next;
+    addPoint(ctx, curPoint);
+    markVisited(ctx, curPoint, true);
+    bool closed = gridKey(ctx, fs1.start) == gridKey(ctx, end);
+    size_t steps = 1;//Steps taken in this segment
+    while(gridKey(ctx, curPoint) != gridKey(ctx, end))//Doing traversal
+    {
+      //Once the end point is one of the 8 neighbours step onto it, a closed loop has to get away from its start first
+      if(llabs(gridCoord(ctx, curPoint.x) - gridCoord(ctx, end.x)) <= 1 && llabs(gridCoord(ctx, curPoint.y) - gridCoord(ctx, end.y)) <= 1 && (!closed || steps >= 25))
+        next = end;
+      else if(!blackBirdN(ctx, curPoint, fs1, next))//Obtain next search point
+        return GREENS_STUCK;
+      steps++;
+      INSTRUMENT_COUNT(STEPS, 1);
+      addPoint(ctx, next);
+      markVisited(ctx, next, true);
+      curPoint = next;
+      if(steps == 24)//Start may be revisited once the traversal is well under way
+          markVisited(ctx, fs1.start, false);
+    }
+    return GREENS_OK;
+}
+
+/*Function to trace one segment with its own visited index. The area terms of the segment are left in ctx.area and, if
+storePoints is set, its points in ctx.points*/
+inline greensStatus greensTraceSegment(greensContext &ctx, const greensSegment &fs1)
+{
+    INSTRUMENT_STAGE(TRACE);
+    ctx.points.clear();
+    areaInit(&ctx.area);
+    if(greensCompile(ctx, fs1.function) != GREENS_OK)
+        return GREENS_BAD_FUNCTION;
+    greensLatch(ctx, fs1.function);
+    initVisited(ctx, std::vector<greensSegment>(1, fs1));
+    if(ctx.tracePoints)
+        ctx.tracePath = traceBegin();
+    greensStatus status = dfs(ctx, fs1);
+    if(ctx.tracePoints)
+        traceFlush();//The path goes to the writer before this thread moves on
+    if(status == GREENS_STUCK)
+    {
+        char where[96];
+        snprintf(where, sizeof(where), " after %zu points", ctx.area.count);
+        ctx.error = "traversal of " + fs1.function + " got stuck" + where;
+    }
+    return status;
+}
+
+/*Function to calculate the area of a shape, the segments are traced one after another and their area terms joined in
+order. If storePoints is set the whole boundary is left in ctx.points*/
+inline greensStatus greensShape(greensContext &ctx, const std::vector<greensSegment> &segments, double &area)
+{
+    area = 0.0;
+    if(segments.empty())
+    {
+        ctx.error = "shape has no segments";
+        return GREENS_NO_SEGMENTS;
+    }
+    areaAccumulator total;
+    areaInit(&total);
+    std::vector<greensPoint> boundary;
+    size_t i;
+    for(i = 0; i < segments.size(); i++)
+    {
+        greensStatus status = greensTraceSegment(ctx, segments[i]);
+        if(status != GREENS_OK)
+            return status;
+        areaAppend(&total, &ctx.area);
+        boundary.insert(boundary.end(), ctx.points.begin(), ctx.points.end());
+    }
+    ctx.area = total;
+    ctx.points.swap(boundary);
+    area = areaResult(&total);
+    return GREENS_OK;
+}
+
+/*Function that determines the next point on the boundary to traverse by identifying the point closest to the linearization
+ of the boundary function at prevPoint. This is called the Blackbird Algorithm. Returns false if every neighbour is
+ visited or out of bounds*/
+inline bool blackBirdN(greensContext &ctx, greensPoint curPoint, const greensSegment &grid1, greensPoint &returned)
+{
+    double partials[3];
+    partialDiff(ctx, grid1.function, curPoint.x, curPoint.y, partials);//Obtain partial derivatives
+    double A = partials[0];
+    double B = partials[1];
+    double C = partials[2] - (curPoint.x * A + curPoint.y * B);
+    double invNorm = 1.0 / sqrt((A * A) + (B * B));
+    double tx[8], ty[8], tDist[8];//Search grid as separate x/y arrays so all 8 distances are computed in one vector loop
+    int i;
+    for (i = 0; i < 8; i++)
+    {
+        tx[i] = curPoint.x + ctx.xc[i];
+        ty[i] = curPoint.y + ctx.yc[i];
+        tDist[i] = std::abs(A * tx[i] + B * ty[i] + C) * invNorm;//Using formula to find distance between point and line
+    }
+    double minDist = HUGE_VAL;
+    for (i = 0; i < 8; i++)//Iterate through search grid
+    {
+        greensPoint tPoint;
+        tPoint.x = tx[i];
+        tPoint.y = ty[i];
+        //Closest point to line that is in bounds and has not been visited before becomes next point in traversal
+        if (tDist[i] < minDist)
+        {
+            if (inBounds(tPoint, grid1) == 1 && !isVisited(ctx, tPoint))
+            {
+                minDist = tDist[i];
+                returned = tPoint;
+            }
+            else
+                INSTRUMENT_COUNT(REJECTED, 1);
+        }
+    }
+    return minDist != HUGE_VAL;
+}
+
+//Function to obtain the grid coordinate of an x- or y-coordinate
+inline long long gridCoord(const greensContext &ctx, double c)
+{
+    return llround(c / ctx.delta);
+}
+
+//Function to pack the grid coordinates of a point into one key, 32 bits each
+inline unsigned long long gridKey(const greensContext &ctx, greensPoint p)
+{
+    return ((unsigned long long)(unsigned int)gridCoord(ctx, p.x) << 32) | (unsigned int)gridCoord(ctx, p.y);
+}
+
+//Function to set up the visited index, dense if the bounding box of all the segments is small enough
+inline void initVisited(greensContext &ctx, const std::vector<greensSegment> &segments)
+{
+    visitedIndex &v = ctx.visited;
+    long long imax = 0, jmax = 0;
+    size_t i;
+    for(i = 0; i < segments.size(); i++)
+    {
+        long long i0 = gridCoord(ctx, segments[i].xmin), i1 = gridCoord(ctx, segments[i].xmax);
+        long long j0 = gridCoord(ctx, segments[i].ymin), j1 = gridCoord(ctx, segments[i].ymax);
+        v.imin = (i == 0) ? i0 : std::min(v.imin, i0);
+        v.jmin = (i == 0) ? j0 : std::min(v.jmin, j0);
+        imax = (i == 0) ? i1 : std::max(imax, i1);
+        jmax = (i == 0) ? j1 : std::max(jmax, j1);
+    }
+    v.width = imax - v.imin + 1;
+    v.height = jmax - v.jmin + 1;
+    v.dense = !segments.empty() && v.width * v.height <= GREENS_DENSE_LIMIT;
+    v.bits.assign(v.dense ? (v.width * v.height + 63) / 64 : 0, 0);
+    v.table.assign(v.dense ? 0 : 1024, 0);
+    v.state.assign(v.table.size(), GREENS_EMPTY_SLOT);
+    v.used = 0;
+}
+
+//Function to determine if a point has been visited
+inline bool isVisited(const greensContext &ctx, greensPoint p)
+{
+    const visitedIndex &v = ctx.visited;
+    INSTRUMENT_COUNT(PROBES, 1);
+    if(v.dense)
+    {
+        long long i = gridCoord(ctx, p.x) - v.imin, j = gridCoord(ctx, p.y) - v.jmin;
+        if(i < 0 || i >= v.width || j < 0 || j >= v.height)//Outside every segment, never visited
+            return false;
+        long long bit = i * v.height + j;
+        return (v.bits[bit >> 6] >> (bit & 63)) & 1;
+    }
+    unsigned long long key = gridKey(ctx, p);
+    size_t mask = v.table.size() - 1;
+    size_t slot = (key * 0x9E3779B97F4A7C15ULL) >> 32 & mask;//Fibonacci hashing, then linear probing
+    while(v.state[slot] != GREENS_EMPTY_SLOT)
+    {
+        if(v.state[slot] == GREENS_USED_SLOT && v.table[slot] == key)
+            return true;
+        INSTRUMENT_COUNT(COLLISIONS, 1);
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
+
+//Function to mark a point as visited(visited = true) or not visited(visited = false)
+inline void markVisited(greensContext &ctx, greensPoint p, bool visited)
+{
+    visitedIndex &v = ctx.visited;
+    INSTRUMENT_COUNT(PROBES, 1);
+    if(v.dense)
+    {
+        long long i = gridCoord(ctx, p.x) - v.imin, j = gridCoord(ctx, p.y) - v.jmin;
+        if(i < 0 || i >= v.width || j < 0 || j >= v.height)//Outside every segment, never looked up
+            return;
+        long long bit = i * v.height + j;
+        if(visited)
+            v.bits[bit >> 6] |= 1ULL << (bit & 63);
+        else
+            v.bits[bit >> 6] &= ~(1ULL << (bit & 63));
+        return;
+    }
+    if(visited && 2 * (v.used + 1) > v.table.size())//Keep the load factor under 1/2
+        growTable(ctx);
+    unsigned long long key = gridKey(ctx, p);
+    size_t mask = v.table.size() - 1;
+    size_t slot = (key * 0x9E3779B97F4A7C15ULL) >> 32 & mask;
+    size_t firstErased = v.table.size();//Erased slot the key can reuse
+    while(v.state[slot] != GREENS_EMPTY_SLOT)
+    {
+        if(v.state[slot] == GREENS_USED_SLOT && v.table[slot] == key)
+        {
+            if(!visited)
+                v.state[slot] = GREENS_ERASED_SLOT;
+            return;
+        }
+        if(v.state[slot] == GREENS_ERASED_SLOT && firstErased == v.table.size())
+            firstErased = slot;
+        INSTRUMENT_COUNT(COLLISIONS, 1);
+        slot = (slot + 1) & mask;
+    }
+    if(!visited)//Not in the table
+        return;
+    if(firstErased != v.table.size())
+        slot = firstErased;
+    else
+        v.used++;
+    v.table[slot] = key;
+    v.state[slot] = GREENS_USED_SLOT;
+}
+
+//Function to double the size of the visited hash table, erased slots are dropped
+inline void growTable(greensContext &ctx)
+{
+    visitedIndex &v = ctx.visited;
+    std::vector<unsigned long long> old;
+    std::vector<unsigned char> oldState;
+    old.swap(v.table);
+    oldState.swap(v.state);
+    v.table.assign(old.size() * 2, 0);
+    v.state.assign(old.size() * 2, GREENS_EMPTY_SLOT);
+    v.used = 0;
+    size_t mask = v.table.size() - 1;
+    size_t i;
+    for(i = 0; i < old.size(); i++)
+    {
+        if(oldState[i] != GREENS_USED_SLOT)
+            continue;
+        size_t slot = (old[i] * 0x9E3779B97F4A7C15ULL) >> 32 & mask;
+        while(v.state[slot] != GREENS_EMPTY_SLOT)
+            slot = (slot + 1) & mask;
+        v.table[slot] = old[i];
+        v.state[slot] = GREENS_USED_SLOT;
+        v.used++;
+    }
+}
+
+//Function to determine if a point is within the overall boundaries of the search
+inline int inBounds(greensPoint p, const greensSegment &grid1)
+{
+    if (p.x >= grid1.xmin && p.x <= grid1.xmax && p.y >= grid1.ymin && p.y <= grid1.ymax)
+        return 1;
+    return 0;
+}
+
+/*Function to compile f(x,y) and set up its derivatives the first time the function string is seen. Symbolic
+differentiation is tried first, then dual numbers over the expression tree, and numerical differentiation is the last
+resort. Returns GREENS_BAD_FUNCTION(with the ExprTk message in ctx.error) if f(x,y) cannot be compiled*/
+inline greensStatus greensCompile(greensContext &ctx, const std::string &function)
+{
+    if(ctx.derivativeCache.count(function))//Already set up
+        return GREENS_OK;
+    INSTRUMENT_STAGE(COMPILE);
+    expression_t *f = getExpression(ctx, function);//Let ExprTk validate the function first
+    if(f == NULL)
+        return GREENS_BAD_FUNCTION;
+    derivativeStruct &derivatives = ctx.derivativeCache[function];
+    derivatives.f = *f;
+    std::string dfdx, dfdy;
+    expression_t *dx = NULL, *dy = NULL;
+    if(symbolicGradient(function, dfdx, dfdy) && (dx = getExpression(ctx, dfdx)) != NULL && (dy = getExpression(ctx, dfdy)) != NULL)
+    {
+        derivatives.method = DIFF_SYMBOLIC;
+        derivatives.dfdx = *dx;
+        derivatives.dfdy = *dy;
+    }
+    else if(parseTree(function, derivatives.tree))
+        derivatives.method = DIFF_DUAL;
+    else
+        derivatives.method = DIFF_NUMERICAL;
+    derivatives.native = nativeLookup(function);
+    ctx.error.clear();//A derivative ExprTk rejected is not an error, another method is used
+    return GREENS_OK;
+}
+
+//Function to obtain the derivatives of f(x,y), set up on first use. Returns NULL if f(x,y) cannot be compiled
+inline derivativeStruct *getDerivatives(greensContext &ctx, const std::string &function)
+{
+    std::unordered_map<std::string, derivativeStruct>::iterator it = ctx.derivativeCache.find(function);
+    if(it != ctx.derivativeCache.end())
+        return &it->second;
+    if(greensCompile(ctx, function) != GREENS_OK)
+        return NULL;
+    return &ctx.derivativeCache[function];
+}
+
+/*Function to decide once, when a trace of f(x,y) starts, whether partialDiff uses the native kernel: only if it is built
+by now. The kernel and the interpreted method do not give bit-identical derivatives, so switching in the middle of a
+trace would make its points and area depend on when the compiler finished*/
+inline void greensLatch(greensContext &ctx, const std::string &function)
+{
+    derivativeStruct *derivatives = getDerivatives(ctx, function);
+    if(derivatives == NULL)
+        return;
+    derivatives->useNative = false;
+    if(derivatives->native == NULL)
+        return;
+    int state = derivatives->native->state.load(std::memory_order_acquire);
+    if(state == NATIVE_FAILED)
+        derivatives->native = NULL;
+    derivatives->useNative = state == NATIVE_READY;
+}
+
+/*Function to calculate the first-order partial derivatives of a function f(x,y) at point (a,b), using the fastest
+method greensCompile found for the function, or its native kernel if greensLatch chose it for this trace.
+partials[0] = df/dx, partials[1] = df/dy, partials[2] = f(a,b). All three are NaN if f(x,y) cannot be compiled*/
+inline void partialDiff(greensContext &ctx, const std::string &function, double a, double b, double partials[])
+{
+    derivativeStruct *derivatives = getDerivatives(ctx, function);
+    if(derivatives == NULL)
+    {
+        partials[0] = partials[1] = partials[2] = NAN;
+        return;
+    }
+    if(derivatives->useNative)
+    {
+        derivatives->native->gradient(a, b, partials);
+        INSTRUMENT_COUNT(EVALUATIONS, 3);
+        return;
+    }
+    switch(derivatives->method)
+    {
+        case DIFF_SYMBOLIC:
+            ctx.xVar = a;
+            ctx.yVar = b;
+            partials[0] = derivatives->dfdx.value();
+            partials[1] = derivatives->dfdy.value();
+            partials[2] = derivatives->f.value();
+            INSTRUMENT_COUNT(EVALUATIONS, 3);
+            break;
+        case DIFF_DUAL:
+            evalDual(derivatives->tree, a, b, partials);
+            INSTRUMENT_COUNT(EVALUATIONS, 3);
+            break;
+        default:
+            numericalPartialDiff(ctx, function, a, b, partials);
+            break;
+    }
+}
+
+//Function to numerically calculate the first-order partial derivatives of a function f(x,y) at point (a,b)
+inline void numericalPartialDiff(greensContext &ctx, const std::string &function, double a, double b, double partials[])
+{
+    double h = ctx.h;
+    partials[0] = (eval(ctx, function, a + h, b) - eval(ctx, function, a - h, b)) / (2 * h);//df/dx
+    partials[1] = (eval(ctx, function, a, b + h) - eval(ctx, function, a, b - h)) / (2 * h);//df/dy
+    partials[2] = eval(ctx, function, a, b);//Value of f at (a,b)
+}
+
+/*Function to obtain the compiled expression for f(x,y). The function string is parsed and compiled the first
+time it is seen, afterwards the cached expression is returned so evaluating only costs an assignment and value().
+Returns NULL(with the ExprTk message in ctx.error) if f(x,y) is not a valid expression that can be evaluated by ExprTk*/
+inline expression_t *getExpression(greensContext &ctx, const std::string &function)
+{
+  std::unordered_map<std::string, expression_t>::iterator it = ctx.expressionCache.find(function);
+  if(it != ctx.expressionCache.end())//Already compiled
+    return &it->second;
+  if(!ctx.symbolTable.symbol_exists("x"))//First compile, bind x and y to xVar and yVar
+  {
+    ctx.symbolTable.add_constants();
+    ctx.symbolTable.add_variable("x", ctx.xVar);
+    ctx.symbolTable.add_variable("y", ctx.yVar);
+  }
+  expression_t expression;
+  expression.register_symbol_table(ctx.symbolTable);
+  INSTRUMENT_COUNT(COMPILES, 1);
+  if(!(ctx.parser.compile(function, expression)))
+  {
+    ctx.error = "Error: " + ctx.parser.error() + "\tExpression: " + function;
+    return NULL;
+  }
+  return &(ctx.expressionCache[function] = expression);
+}
+
+//Evaluate a function f(x,y) at a point (x,y), return value of function at point (x,y) or NaN if it cannot be compiled
+inline double eval(greensContext &ctx, const std::string &function, double a, double b)
+{
+  expression_t *expression = getExpression(ctx, function);
+  if(expression == NULL)
+    return NAN;
+  ctx.xVar = a;
+  ctx.yVar = b;
+  INSTRUMENT_COUNT(EVALUATIONS, 1);
+  return expression->value();
+}
+
+/*Function to determine if f(x,y) only uses operations that ExprTk applies element by element to vectors: the arithmetic
+operators, x, y, numbers, pi and the single argument functions. Anything else(if, min, max, hypot...) is evaluated point by point*/
+inline bool isElementWise(const std::string &function)
+{
+    static const std::unordered_set<std::string> allowed = {"x", "y", "pi", "abs", "acos", "acosh", "asin", "asinh", "atan", "atanh",
+        "ceil", "cos", "cosh", "cot", "csc", "erf", "erfc", "exp", "expm1", "floor", "frac", "log", "log10", "log1p",
+        "log2", "ncdf", "round", "sec", "sgn", "sin", "sinc", "sinh", "sqrt", "tan", "tanh", "trunc"};
+    size_t i = 0;
+    while(i < function.size())
+    {
+        char c = function[i];
+        if(isalpha(c) || c == '_')//Identifier
+        {
+            size_t j = i;
+            while(j < function.size() && (isalnum(function[j]) || function[j] == '_'))
+                j++;
+            if(allowed.count(function.substr(i, j - i)) == 0)
+                return false;
+            i = j;
+        }
+        else if(isdigit(c) || c == '.')//Number, including exponents such as 1e-3
+        {
+            while(i < function.size() && (isdigit(function[i]) || function[i] == '.'))
+                i++;
+            if(i < function.size() && (function[i] == 'e' || function[i] == 'E'))
+            {
+                i++;
+                if(i < function.size() && (function[i] == '+' || function[i] == '-'))
+                    i++;
+            }
+        }
+        else if(strchr("+-*/^() \t", c) != NULL)
+            i++;
+        else
+            return false;
+    }
+    return true;
+}
+
+//Function to obtain the vector form of f(x,y), compiled the first time the function string is seen
+inline blockExpression &getBlockExpression(greensContext &ctx, const std::string &function)
+{
+    std::unordered_map<std::string, blockExpression>::iterator it = ctx.blockCache.find(function);
+    if(it != ctx.blockCache.end())//Already compiled
+        return it->second;
+    if(!ctx.blockSymbolTable.symbol_exists("x"))//First compile, bind x, y and fBlock to the block buffers
+    {
+        ctx.blockSymbolTable.add_constants();
+        ctx.blockSymbolTable.add_vector("x", ctx.xBlock);
+        ctx.blockSymbolTable.add_vector("y", ctx.yBlock);
+        ctx.blockSymbolTable.add_vector("fBlock", ctx.fBlock);
+    }
+    blockExpression &block = ctx.blockCache[function];
+    block.vectorized = false;
+    exprTree tree;
+    block.parsed = parseTree(function, tree);
+    if(block.parsed)
+        compileTreeBlock(tree, block.tree);
+    if(!block.parsed && isElementWise(function))
+    {
+        block.expression.register_symbol_table(ctx.blockSymbolTable);
+        INSTRUMENT_COUNT(COMPILES, 1);
+        block.vectorized = ctx.parser.compile("fBlock := (" + function + ")", block.expression);
+    }
+    return block;
+}
+
+/*Function to evaluate f(x,y) at the n points (xs[i],ys[i]) and store the values in results. Functions the expression tree
+can parse are evaluated over it, other element-wise functions GREENS_BLOCK_SIZE points at a time by the vector form of the
+expression, everything else falls back to eval*/
+inline void evalBlock(greensContext &ctx, const std::string &function, const double *xs, const double *ys, double *results, int n)
+{
+    blockExpression &block = getBlockExpression(ctx, function);
+    int i, j;
+    if(block.parsed)
+    {
+        evalTreeBlock(block.tree, xs, ys, results, n);
+        INSTRUMENT_COUNT(EVALUATIONS, n);
+        return;
+    }
+    if(!block.vectorized)
+    {
+        for(i = 0; i < n; i++)
+            results[i] = eval(ctx, function, xs[i], ys[i]);
+        return;
+    }
+    for(i = 0; i < n; i += GREENS_BLOCK_SIZE)
+    {
+        int count = std::min(GREENS_BLOCK_SIZE, n - i);
+        for(j = 0; j < GREENS_BLOCK_SIZE; j++)//Unused lanes repeat the first point of the block
+        {
+            ctx.xBlock[j] = xs[i + (j < count ? j : 0)];
+            ctx.yBlock[j] = ys[i + (j < count ? j : 0)];
+        }
+        block.expression.value();
+        INSTRUMENT_COUNT(EVALUATIONS, count);
+        for(j = 0; j < count; j++)
+            results[i + j] = ctx.fBlock[j];
+    }
+}
+
+/*Function that actually calculates area, given points along boundary of shape
+using variation of Green's Theorem*/
+inline double calcArea(const std::vector<greensPoint> &orderedPoints)
+{
+  INSTRUMENT_STAGE(AREA);
+  if(orderedPoints.empty())
+    return 0.0;
+  return polygonArea(&orderedPoints[0].x, &orderedPoints[0].y, orderedPoints.size(), 2);
+}
+
+#endif
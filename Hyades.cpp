@@ -5,220 +5,304 @@
   University of California, Santa Barbara College of Creative Studies(CCS)*/
 //October 19, 2016
 /*Hyades v1.0-C++ program that numerically calculates the area of complicated shapes
-in R^2 using a variation of Green's Theorem*/
+in R^2 using a variation of Green's Theorem. The traversal itself is the greens library(Greens.hpp)*/
 
 #include <iostream>
 #include <vector>
-#include <cmath>
-#include <unordered_set>
 #include <string>
-#include <ctime>
-#include "exprtk.hpp"
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include "Greens.hpp"
+#include "Manifest.hpp"
+#include "Daemon.hpp"
+#include "ResultCache.hpp"
+#include "Scheduler.hpp"
+#include "Instrument.hpp"
+#include "TraceSink.hpp"
+#include "ZeroSet.hpp"
 using namespace std;
 
-double DELTA = 0.05;//Step Size
-double h = 0.0000001;//Needed for numerical differentiation
-double EPSILON = 0.00001;//Epsilon needed for operations with doubles
-//Search order: up, down, left, right, upper left, lower right, upper right, lower left
-double xc[] = {0, 0, -1 * DELTA, DELTA, -1 * DELTA, DELTA, DELTA, -1 * DELTA};//Search grid
-double yc[] = {DELTA, -1 * DELTA, 0, 0, DELTA, -1 * DELTA, DELTA, -1 * DELTA};
-
 /*****************************Structure Definitions**************************/
-//Point structure for a point (x,y)
-struct point{
-    double x;//x-coordinate
-    double y;//y-coordinate
-};
+typedef greensPoint point;//Point structure for a point (x,y)
+typedef greensSegment functionStruct;//Function f(x,y), start and end points and bounds of one segment of the boundary
 
-//Overload == operator for use with points
-inline bool operator == (point const& p, point const& q)
-{
-    return (abs(p.x - q.x) <= EPSILON && abs(p.y - q.y) <= EPSILON);
-}
-
-namespace std
-{
-    //Implements R17L23XOR Hash Algorithm
-    template <>
-    struct hash<point>
-    {
-        size_t operator()(point const &point1) const{
-          unsigned int id1, id2;
-          if(point1.x > 0)
-            id1 = point1.x * 10000010;
-          else
-            id1 = point1.x * 10000000;
-          if(point1.y > 0)
-            id2 = point1.y * 10000010;
-          else
-            id2 = point1.y * 10000000;
-          id1 = id1 >> 17;
-          id1 = id1 << 23;
-          id2 = id2 >> 17;
-          id2 = id2 << 23;
-          return ((id1 ^ id2));
-        }
-    };
-}
-
-/*Function structure contains function f(x,y) as well as the minimum and maximum x-
-and y- coordinates for which the function is defined*/
-struct functionStruct {
-    string function;//f(x,y) that forms boundary of shape
-    point start;//Starting point of traversal
-    point end;//End point of traversal. For a closed loop, start = end
-    double xmin;//Min. x-coordinate of function
-    double xmax;//Max. x-coordinate of function
-    double ymin;//Min. y-coordinate of function
-    double ymax;//Max. y-coordinate of function
+/*Segments are traced in parallel as tasks of a work-stealing pool(see Scheduler.hpp). Each thread traces with its own
+greensContext, so the workers share nothing until the per-segment results are stitched together in order*/
+unsigned NUM_THREADS = 0;//Number of worker threads, 0 uses every core
+thread_local greensContext context;//Traversal state of this thread
+thread_local vector<point> orderedPoints;//Stores points in order, only filled if storePoints is set
+bool storePoints = false;//Set to keep the boundary points, otherwise only the running area is kept
+thread_local areaAccumulator areaStream;//Area of the whole boundary
+resultMemo memo;//Shapes already computed in batch and daemon mode, see ResultCache.hpp
+struct segmentResult {
+    greensStatus status;
+    string error;//Why the segment could not be traced
+    vector<point> points;//Points of the segment, only if storePoints is set
+    areaAccumulator area;//Area terms of the segment
 };
 
-vector<point> orderedPoints;//Stores points in order
-unordered_set<point, hash<point> > visitedPoints;//Hash table to store visited points
-//Type definitions from ExprTk library
-typedef exprtk::symbol_table<double> symbol_table_t;
-typedef exprtk::expression<double> expression_t;
-typedef exprtk::parser<double> parser_t;
-expression_t expression;//Setting up evaluation infrastructure-no need to do this multiple times
-parser_t parser;
-
 /**********************Function Declarations**********************************/
-void printPoint();//Function to print a strung representation of a point
-void dfs(functionStruct);//Function to obtain points along boundary of shape
-point blackBirdN(point, functionStruct);//Function to determine the next point in the search
-int inBounds(point, functionStruct);//Function to determine if a point is within the overall boundaries of the search
-double eval(string, double, double);//Function to evaluate the function at a point (x,y)
-double *numericalPartialDiff(string, double, double);//Function to numerically calculate the partial derivatives a two-variable function f(x,y)
-double calcArea(vector<point>);//Function to calculate area
+void traceSegment(const functionStruct &, segmentResult &);//Function to trace one segment on the calling thread
+bool traceSegments(const vector<functionStruct> &, string &);//Function to trace every segment in parallel and stitch the results
+bool traceRegion(const functionStruct &, double &, size_t &, string &);//Function to find the whole boundary of a region without start points
+string shapeKey(const vector<functionStruct> &);//Function to build the memo key of a shape
+string regionKey(const functionStruct &);//Function to build the memo key of a region
+shapeResult computeShape(const manifestShape &);//Function to calculate the area of one shape of a batch manifest
 
-//Function to cprint a string representation of a point
-void printPoint(point point1)
+//Function to trace one segment with this thread's context
+void traceSegment(const functionStruct &fs1, segmentResult &result)
 {
-  printf("(%lf, %lf) ", point1.x, point1.y);
+    context.storePoints = storePoints;
+    context.tracePoints = traceEnabled();
+    result.status = greensTraceSegment(context, fs1);
+    result.error = context.error;
+    result.points.swap(context.points);
+    result.area = context.area;
 }
 
-/*
-Given function f(x,y) = 0 for boundary(or segment of boundary of shape), obtain
-points (x,y) along boundary of shape to give to chenLai to calculate area.
-*/
-void dfs(functionStruct fs1)
+/*Function to trace every segment of the boundary. Segments are independent given their start and end points, so each
+one is a task of the active work-stealing pool(idle batch workers steal the segments of an expensive shape). Without a
+pool(daemon workers) the segments are traced one after another. The results are stitched in segment order into
+orderedPoints and areaStream. Returns false with the reason in error if a segment could not be traced*/
+bool traceSegments(const vector<functionStruct> &segments, string &error)
 {
-    point curPoint, end, next;
-    curPoint = fs1.start;
-    end = fs1.end;
-    orderedPoints.push_back(curPoint);//Adding starting and first points to storage
-    visitedPoints.insert(curPoint);
-    curPoint = blackBirdN(curPoint, fs1);
-    orderedPoints.push_back(curPoint);
-    visitedPoints.insert(curPoint);
-    while(!(curPoint == end))//Doing traversal
+    vector<segmentResult> results(segments.size());
+    workStealingPool *pool = activePool();
+    size_t k;
+    if(pool == NULL || segments.size() == 1)//Nothing to split onto, or nothing to split
     {
-      next = blackBirdN(curPoint, fs1);//Obtain next search point
-      printPoint(next);
-      orderedPoints.push_back(next);//Add to storage
-      visitedPoints.insert(next);
-      curPoint = next;
-      if(visitedPoints.load_factor() >= 0.67)//Rehash if necessary
-          visitedPoints.rehash(visitedPoints.bucket_count() * 2);
-      if(orderedPoints.size() == 25)
-          visitedPoints.erase(fs1.start);
+      for(k = 0; k < segments.size(); k++)
+        traceSegment(segments[k], results[k]);
     }
+    else
+    {
+      taskGroup group;
+      for(k = 0; k < segments.size(); k++)
+        poolSpawn(*pool, group, [&segments, &results, k]() { traceSegment(segments[k], results[k]); });
+      poolWait(*pool, group);//Traces segments here too
+    }
+    orderedPoints.clear();
+    areaInit(&areaStream);
+    for(k = 0; k < results.size(); k++)//Stitch in order
+    {
+      if(results[k].status != GREENS_OK)
+      {
+        error = results[k].error;
+        return false;
+      }
+      orderedPoints.insert(orderedPoints.end(), results[k].points.begin(), results[k].points.end());
+      areaAppend(&areaStream, &results[k].area);
+    }
+    return true;
 }
 
-/*Function that determines the next point on the boundary to traverse by identifying the point closest to the linearization
- of the boundary function at prevPoint. This is called the Blackbird Algorithm*/
-point blackBirdN(point curPoint, functionStruct grid1)
+/*Function to find the whole boundary of the region f(x,y) < 0 inside the box of region with the quadtree of ZeroSet.hpp,
+leaves delta wide. Every component and hole is found, start and end of region are not used. Subtrees are tasks of the
+active pool, each thread evaluates f with its own context. orderedPoints is given the polygons one after another if
+storePoints is set, and each polygon is a path of the trace sink. Returns false with the reason in error if f cannot be
+compiled or the box is empty*/
+bool traceRegion(const functionStruct &region, double &area, size_t &points, string &error)
 {
-    point returned;
-    double *partialPtr = numericalPartialDiff(grid1.function, curPoint.x, curPoint.y);//Obtain partial derivatives
-    double A = *partialPtr;//Use pointer arithmetic
-    double B = *(partialPtr + 1);
-    double C = (*(partialPtr + 2)) - (curPoint.x * A + curPoint.y * B);
-    double minDist = HUGE_VAL;
-    int i;
-    for (i = 0; i < 8; i++)//Iterate through search grid
+    if(greensCompile(context, region.function) != GREENS_OK)
     {
-        point tPoint;
-        tPoint.x = curPoint.x + xc[i];
-        tPoint.y = curPoint.y + yc[i];
-        if(visitedPoints.count(tPoint) == 0 && inBounds(tPoint, grid1) == 1)//If point is in bounds and has not been visited before
-        {
-              double tDist = abs(A * tPoint.x + B * tPoint.y + C) / sqrt((A * A) + (B * B));//Using formula to find distance between point and line
-              if (tDist < minDist)//Closest point to line becomes next point in traversal
-              {
-                  minDist = tDist;
-                  returned = tPoint;
-              }
-        }
+      error = context.error;
+      return false;
+    }
+    const string &function = region.function;
+    zeroSetEvaluator evaluate = [&function](const double *xs, const double *ys, double *values, int n) {
+      evalBlock(context, function, xs, ys, values, n);//context of the thread running the subtree
+    };
+    zeroSetResult zeroSet;
+    if(!zeroSetExtract(function, evaluate, region.xmin, region.xmax, region.ymin, region.ymax, context.delta, zeroSet))
+    {
+      error = "region box is empty";
+      return false;
+    }
+    orderedPoints.clear();
+    bool trace = traceEnabled();
+    size_t i, k;
+    for(k = 0; k < zeroSet.polygons.size(); k++)
+    {
+      const vector<zeroSetPoint> &polygon = zeroSet.polygons[k];
+      uint64_t path = trace ? traceBegin() : 0;
+      for(i = 0; i < polygon.size(); i++)
+      {
+        point p;
+        p.x = polygon[i].x;
+        p.y = polygon[i].y;
+        if(storePoints)
+          orderedPoints.push_back(p);
+        if(trace)
+          tracePoint(path, p.x, p.y);
+      }
     }
-    return returned;
+    if(trace)
+      traceFlush();
+    area = zeroSet.area;
+    points = zeroSet.points;
+    return true;
 }
 
-//Function to determine if a point is within the overall boundaries of the search
-int inBounds(point p, functionStruct grid1)
+/*Function to build the memo key of a shape: the settings the traversal depends on, then every segment with its numbers
+printed exactly and its function without whitespace, in order*/
+string shapeKey(const vector<functionStruct> &segments)
 {
-    if (p.x >= grid1.xmin && p.x <= grid1.xmax && p.y >= grid1.ymin && p.y <= grid1.ymax)
-        return 1;
-    return 0;
-}
-
-//Function to numerically calculate the first-order partial derivatives of a function f(x,y) at point (a,b)
-double* numericalPartialDiff(string function, double a, double b) {
-    double partials[3];
-    double *returnPtr;
-    returnPtr = partials;
-    partials[0] = (eval(function, a + h, b) - eval(function, a - h, b)) / (2 * h);//df/dx
-    partials[1] = (eval(function, a, b + h) - eval(function, a, b - h)) / (2 * h);//df/dy
-    partials[2] = eval(function, a, b);//Value of f at (a,b)
-    return returnPtr;
+    string key = "Hyades DELTA=" + memoNumber(context.delta) + " h=" + memoNumber(context.h);
+    size_t i;
+    for(i = 0; i < segments.size(); i++)
+    {
+      const functionStruct &fs1 = segments[i];
+      key += " | " + memoNumber(fs1.start.x) + " " + memoNumber(fs1.start.y) + " " + memoNumber(fs1.end.x) + " " + memoNumber(fs1.end.y);
+      key += " " + memoNumber(fs1.xmin) + " " + memoNumber(fs1.xmax) + " " + memoNumber(fs1.ymin) + " " + memoNumber(fs1.ymax);
+      key += " " + memoFunction(fs1.function);
+    }
+    return key;
 }
 
-//Evaluate a function f(x,y) at a point (x,y), return value of function at point (x,y)
-double eval(string function, double a, double b)
+//Function to build the memo key of a region: the leaf size, then its box with the numbers printed exactly and its function
+string regionKey(const functionStruct &region)
 {
-  symbol_table_t symbol_table;
-  symbol_table.add_constants();
-  symbol_table.add_variable("x", a);
-  symbol_table.add_variable("y", b);
-  expression.register_symbol_table(symbol_table);
-  if(!(parser.compile(function, expression)))//If f(x,y) is not a valid expression that can be evaluated by ExprTk
-  {
-    printf("Error: %s\tExpression: %s\n", parser.error().c_str(), function.c_str());
-    exit(0);
-  }
-  double result = expression.value();
-  return result;
+    string key = "Hyades region DELTA=" + memoNumber(context.delta);
+    key += " | " + memoNumber(region.xmin) + " " + memoNumber(region.xmax) + " " + memoNumber(region.ymin) + " " + memoNumber(region.ymax);
+    return key + " " + memoFunction(region.function);
 }
 
-
-/*Function that actually calculates area, given points along boundary of shape
-using variation of Green's Theorem*/
-double calcArea(vector<point> orderedPoints)
+/*Function to calculate the area of one shape of a batch manifest. Each line of the shape is
+"segment startx starty endx endy xmin xmax ymin ymax f(x,y)", or the shape is the single line
+"region xmin xmax ymin ymax f(x,y)": the area where f(x,y) < 0 inside the box, found without start points(see traceRegion).
+The segments are tasks of the batch pool, every worker reuses its compiled expressions for every segment it is given. A
+shape that is already in the memo is not traced again*/
+shapeResult computeShape(const manifestShape &shape)
 {
-  double area = 0.0;
-  int idx = 0;//Index in vector
-  int numItr = 0;//Number of iterations(additions). Actual formula is defined using series
-  int size = orderedPoints.size();
-  while(numItr < size)
-  {
-      if(numItr < size - 1)
-          area += ((orderedPoints[idx].x * orderedPoints[idx + 1].y) - (orderedPoints[idx].y * orderedPoints[idx + 1].x));
-      else
-          area += ((orderedPoints[idx].x * orderedPoints[0].y) - (orderedPoints[0].x * orderedPoints[idx].y));
-      idx++;
-      numItr++;
-  }
-  if(area < 0)//Area cannot be negative
-  {
-      area *= -1;
-  }
-  return (area / 2);
+    shapeResult result;
+    result.ok = false;
+    result.area = 0.0;
+    result.points = 0;
+    vector<functionStruct> segments;
+    functionStruct region;//Only used by a region shape
+    bool isRegion = false;
+    size_t i;
+    for(i = 0; i < shape.lines.size(); i++)
+    {
+      const manifestLine &line = shape.lines[i];
+      functionStruct fs1;
+      double v[8];
+      if(line.keyword == "region")
+      {
+        if(shape.lines.size() != 1 || !takeNumbers(line.rest, 4, v, region.function) || region.function.empty())
+        {
+          result.error = "line " + to_string(line.line) + ": expected region xmin xmax ymin ymax f(x,y), alone in its shape";
+          return result;
+        }
+        region.xmin = v[0];
+        region.xmax = v[1];
+        region.ymin = v[2];
+        region.ymax = v[3];
+        isRegion = true;
+        break;
+      }
+      if(line.keyword != "segment" || !takeNumbers(line.rest, 8, v, fs1.function) || fs1.function.empty())
+      {
+        result.error = "line " + to_string(line.line) + ": expected segment startx starty endx endy xmin xmax ymin ymax f(x,y)";
+        return result;
+      }
+      fs1.start.x = v[0];
+      fs1.start.y = v[1];
+      fs1.end.x = v[2];
+      fs1.end.y = v[3];
+      fs1.xmin = v[4];
+      fs1.xmax = v[5];
+      fs1.ymin = v[6];
+      fs1.ymax = v[7];
+      segments.push_back(fs1);
+    }
+    if(segments.empty() && !isRegion)
+    {
+      result.error = "shape has no segments";
+      return result;
+    }
+    string key = isRegion ? regionKey(region) : shapeKey(segments);
+    memoEntry entry;
+    if(memoLookup(memo, key, storePoints, entry))//Computed before, orderedPoints is given the stored boundary
+    {
+      if(storePoints)
+      {
+        orderedPoints.resize(entry.xy.size() / 2);
+        for(i = 0; i < orderedPoints.size(); i++)
+        {
+          orderedPoints[i].x = entry.xy[2 * i];
+          orderedPoints[i].y = entry.xy[2 * i + 1];
+        }
+      }
+      result.ok = true;
+      result.area = entry.area;
+      result.points = entry.points;
+      return result;
+    }
+    if(isRegion)
+    {
+      if(!traceRegion(region, result.area, result.points, result.error))
+        return result;
+    }
+    else
+    {
+      if(!traceSegments(segments, result.error))
+        return result;
+      result.area = areaResult(&areaStream);
+      result.points = areaStream.count;
+    }
+    result.ok = true;
+    entry.area = result.area;
+    entry.points = result.points;
+    for(i = 0; i < orderedPoints.size(); i++)//Only filled if storePoints is set
+    {
+      entry.xy.push_back(orderedPoints[i].x);
+      entry.xy.push_back(orderedPoints[i].y);
+    }
+    memoStore(memo, key, entry);
+    return result;
 }
 
-int main() {
+/*Hyades computes the shape below, with --batch every shape of a manifest(see Manifest.hpp)
+or with --daemon shape requests from stdin or a Unix socket(see Daemon.hpp):
+Hyades --batch manifest.txt [results.csv]
+Hyades --daemon [socket path]
+Any of them can be preceded by these options:
+--memo dir to keep the results of computed shapes in dir across runs(see ResultCache.hpp)
+--profile report.csv(or .json) to write the counters and stage times of every shape, in a build with -DGREENS_INSTRUMENT(see Instrument.hpp)
+--trace trace.csv(or .bin) to record every boundary point found(see TraceSink.hpp)
+--native kernels to compile each function to machine code, cached in the directory kernels(see NativeKernel.hpp)*/
+int main(int argc, char *argv[]) {
+    while(argc > 2)//Options, in any order
+    {
+      string option = argv[1];
+      if(option == "--memo")
+        memo.dir = argv[2];
+      else if(option == "--profile")
+        instrumentProfile(argv[2]);
+      else if(option == "--trace")
+      {
+        if(!traceOpen(argv[2]))
+          return 1;
+      }
+      else if(option == "--native")
+      {
+        if(!nativeEnable(argv[2]))
+          return 1;
+      }
+      else
+        break;
+      argc -= 2;
+      argv += 2;
+    }
+    if(argc > 2 && string(argv[1]) == "--batch")
+      return runBatch(argv[2], argc > 3 ? argv[3] : NULL, NUM_THREADS, computeShape);
+    if(argc > 1 && string(argv[1]) == "--daemon")
+      return runDaemon(argc > 2 ? argv[2] : NULL, NUM_THREADS, computeShape);
     functionStruct fs0, fs1;
-    fs0.function = "x*x";
-    fs1.function = "2*x";
+    fs0.function = "y-x*x";
+    fs1.function = "y-2*x";
     fs0.xmin = 0.0;
     fs0.xmax = 2.0;
     fs0.ymin = 0.0;
@@ -239,18 +323,24 @@ int main() {
     vector<functionStruct> functionVector;
     functionVector.push_back(fs0);
     functionVector.push_back(fs1);
-    clock_t clk;
-    clk = clock();
-    int i;
-    for(i = 0; i < functionVector.size(); i++)//Do search
+    INSTRUMENT_SHAPE("Hyades");
+    chrono::steady_clock::time_point clk = chrono::steady_clock::now();//Wall time, clock() would add up every thread
+    string error;
+    workStealingPool pool;
+    poolStart(pool, (unsigned)min((size_t)(NUM_THREADS ? NUM_THREADS : max(1u, thread::hardware_concurrency())), functionVector.size()));
+    activePool() = &pool;
+    bool traced = traceSegments(functionVector, error);//Do search
+    activePool() = NULL;
+    poolStop(pool);
+    if(!traced)
     {
-      functionStruct fs1 = functionVector[i];
-      dfs(fs1);
+      printf("%s\n", error.c_str());
+      return 1;
     }
-    double area = calcArea(orderedPoints);//Calculate area
-    clk = clock() - clk;
+    double area = areaResult(&areaStream);//Area was calculated during the search
+    double runtime = chrono::duration<double>(chrono::steady_clock::now() - clk).count();
     printf("The area of the shape is: %lf\n", area);
-    printf("Size of vector: %lu\n", orderedPoints.size());
-    printf("Runtime: %lf\n", ((double)clk) / CLOCKS_PER_SEC);
+    printf("Number of points: %lu\n", areaStream.count);
+    printf("Runtime: %lf\n", runtime);
     return 0;
 }
@@ -0,0 +1,329 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Instrument - counters and stage timers for the hot paths, so production runs can be tuned from data. The hot paths use
+the macros below, which compile to nothing unless the program is built with -DGREENS_INSTRUMENT:
+    INSTRUMENT_COUNT(EVALUATIONS, 3);//Add to a counter: EVALUATIONS, COMPILES, PROBES, COLLISIONS, STEPS, REJECTED, NEWTON
+    INSTRUMENT_STAGE(TRACE);//Time the rest of the block as a stage: PARSE, COMPILE, TRACE, ORDER, AREA, MEMO
+    INSTRUMENT_SHAPE(name);//Count the rest of the block as the shape name and add it to the report
+    INSTRUMENT_WRAP(task);//Count a pool task for the shape that spawned it(see Scheduler.hpp)
+Counts go to the counters active on the calling thread(those of the shape it is computing), a thread without any drops
+them. Stage times are exclusive: a stage started inside another one stops the clock of the outer stage until it ends, so
+the stages of a shape add up to at most its total time. Work a shape hands to pool tasks is counted on the thread that runs
+the task and added to the shape when the task ends, so stage seconds add up the time of every thread that worked on it.
+With --profile path each program writes one record per shape when it is done: JSON if path ends in .json, otherwise CSV
+with the columns shape,evaluations,compiles,visited_probes,visited_collisions,steps,rejected_neighbours,newton_iterations,
+parse_s,compile_s,trace_s,order_s,area_s,memo_s,total_s*/
+
+#ifndef INSTRUMENT_HPP
+#define INSTRUMENT_HPP
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+
+/*****************************Structure Definitions**************************/
+enum instrumentCounter {
+    INSTRUMENT_EVALUATIONS,//Values of f, df/dx or df/dy computed
+    INSTRUMENT_COMPILES,//Expressions compiled by ExprTk
+    INSTRUMENT_PROBES,//Lookups and updates of the visited index
+    INSTRUMENT_COLLISIONS,//Slots of the visited hash table skipped over by those lookups
+    INSTRUMENT_STEPS,//Boundary points taken by a traversal
+    INSTRUMENT_REJECTED,//Closer neighbours blackBirdN passed over because they were out of bounds or visited
+    INSTRUMENT_NEWTON,//Iterations of the Newton corrector
+    INSTRUMENT_NUM_COUNTERS
+};
+const char *const INSTRUMENT_COUNTER_NAMES[] = {"evaluations", "compiles", "visited_probes", "visited_collisions", "steps", "rejected_neighbours", "newton_iterations"};
+
+enum instrumentStage {
+    INSTRUMENT_STAGE_PARSE,//Reading the shape
+    INSTRUMENT_STAGE_COMPILE,//Compiling expressions and setting up derivatives
+    INSTRUMENT_STAGE_TRACE,//Finding the boundary points
+    INSTRUMENT_STAGE_ORDER,//Ordering given points(hull or modifiedGraham)
+    INSTRUMENT_STAGE_AREA,//Summing the area
+    INSTRUMENT_STAGE_MEMO,//Looking up and storing results in the memo
+    INSTRUMENT_NUM_STAGES
+};
+const char *const INSTRUMENT_STAGE_NAMES[] = {"parse", "compile", "trace", "order", "area", "memo"};
+
+//Counts and stage times of one shape(or one task of it)
+struct instrumentCounters {
+    unsigned long long counts[INSTRUMENT_NUM_COUNTERS];
+    double seconds[INSTRUMENT_NUM_STAGES];
+    instrumentCounters()
+    {
+        int i;
+        for(i = 0; i < INSTRUMENT_NUM_COUNTERS; i++)
+            counts[i] = 0;
+        for(i = 0; i < INSTRUMENT_NUM_STAGES; i++)
+            seconds[i] = 0.0;
+    }
+};
+
+//What the calling thread is counting for
+struct instrumentThread {
+    instrumentCounters *counters;//NULL if the thread is not working for a shape
+    int stage;//Stage the clock is running for, -1 for none
+    std::chrono::steady_clock::time_point since;//When the clock was last read
+};
+
+//Finished shape
+struct instrumentRecord {
+    std::string name;
+    instrumentCounters counters;
+    double seconds;//Total wall time
+};
+
+//Report of every finished shape, written by instrumentWrite
+struct instrumentLog {
+    std::mutex lock;//Also taken to add the counts of a task to its shape
+    std::vector<instrumentRecord> records;
+    std::string path;//Where the report goes, empty if no report was asked for
+};
+
+/**********************Function Declarations**********************************/
+instrumentThread &instrumentState();//Function to obtain what the calling thread is counting for
+instrumentLog &instrumentReport();//Function to obtain the report of finished shapes
+void instrumentCharge(instrumentThread &);//Function to add the time since the clock was last read to the running stage
+void instrumentAdd(instrumentCounter, unsigned long long);//Function to add to a counter of the calling thread
+void instrumentMerge(instrumentCounters &, const instrumentCounters &);//Function to add one set of counters to another
+std::function<void()> instrumentWrap(const std::function<void()> &);//Function to count a task for the shape that spawns it
+bool instrumentProfile(const char *);//Function to ask for a report
+void instrumentWrite();//Function to write the report
+
+//Function to obtain what the calling thread is counting for
+inline instrumentThread &instrumentState()
+{
+    static thread_local instrumentThread state = {NULL, -1, std::chrono::steady_clock::time_point()};
+    return state;
+}
+
+//Function to obtain the report of finished shapes
+inline instrumentLog &instrumentReport()
+{
+    static instrumentLog log;
+    return log;
+}
+
+//Function to add the time since the clock was last read to the stage it is running for
+inline void instrumentCharge(instrumentThread &state)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(state.counters != NULL && state.stage >= 0)
+        state.counters->seconds[state.stage] += std::chrono::duration<double>(now - state.since).count();
+    state.since = now;
+}
+
+//Function to add amount to a counter of the calling thread
+inline void instrumentAdd(instrumentCounter counter, unsigned long long amount)
+{
+    instrumentCounters *counters = instrumentState().counters;
+    if(counters != NULL)
+        counters->counts[counter] += amount;
+}
+
+//Function to add the counts and stage times of from to into
+inline void instrumentMerge(instrumentCounters &into, const instrumentCounters &from)
+{
+    int i;
+    for(i = 0; i < INSTRUMENT_NUM_COUNTERS; i++)
+        into.counts[i] += from.counts[i];
+    for(i = 0; i < INSTRUMENT_NUM_STAGES; i++)
+        into.seconds[i] += from.seconds[i];
+}
+
+/*Makes counters the active counters of the calling thread until the end of the scope, the counters and running stage of
+the thread are put back afterwards. With parent set(a task) the counters are added to parent at the end, under the report
+lock. A scope may start on a thread that is waiting in poolWait for the tasks of its shape(a task or another shape of the
+batch runs there meanwhile), whose counters other threads are adding their tasks to, so when the thread is already
+counting for something the running stage is charged on the way in under the lock too*/
+class instrumentScope {
+public:
+    instrumentScope(instrumentCounters *counters, instrumentCounters *parent1 = NULL) : parent(parent1)
+    {
+        instrumentThread &state = instrumentState();
+        if(state.counters != NULL)
+        {
+            std::lock_guard<std::mutex> guard(instrumentReport().lock);
+            instrumentCharge(state);
+        }
+        else
+            instrumentCharge(state);
+        saved = state;
+        state.counters = counters;
+        state.stage = -1;
+    }
+    ~instrumentScope()
+    {
+        instrumentThread &state = instrumentState();
+        instrumentCharge(state);
+        instrumentCounters *counters = state.counters;
+        state.counters = saved.counters;
+        state.stage = saved.stage;//Time spent in this scope is not charged to the outer stage
+        if(parent != NULL)
+        {
+            std::lock_guard<std::mutex> guard(instrumentReport().lock);
+            instrumentMerge(*parent, *counters);
+        }
+    }
+    instrumentScope(const instrumentScope &) = delete;
+    instrumentScope &operator=(const instrumentScope &) = delete;
+private:
+    instrumentThread saved;
+    instrumentCounters *parent;
+};
+
+//Runs the clock for stage until the end of the scope, then for the stage that was running before
+class instrumentTimer {
+public:
+    instrumentTimer(instrumentStage stage)
+    {
+        instrumentThread &state = instrumentState();
+        instrumentCharge(state);
+        previous = state.stage;
+        state.stage = stage;
+    }
+    ~instrumentTimer()
+    {
+        instrumentThread &state = instrumentState();
+        instrumentCharge(state);
+        state.stage = previous;
+    }
+private:
+    int previous;
+};
+
+//Counts the rest of its scope as one shape and adds it to the report at the end, if a report was asked for
+class instrumentShape {
+public:
+    instrumentShape(const std::string &name1) : name(name1), start(std::chrono::steady_clock::now()), scope(&counters) {}
+    ~instrumentShape()
+    {
+        instrumentCharge(instrumentState());
+        instrumentLog &log = instrumentReport();
+        std::lock_guard<std::mutex> guard(log.lock);
+        if(log.path.empty())
+            return;
+        instrumentRecord record;
+        record.name = name;
+        record.counters = counters;
+        record.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        log.records.push_back(record);
+    }
+private:
+    std::string name;
+    instrumentCounters counters;
+    std::chrono::steady_clock::time_point start;
+    instrumentScope scope;//Declared last so it is set up after counters
+};
+
+/*Function to count a task for the shape whose thread spawns it: the task counts into its own counters, which are added to
+the shape's under the report lock when it ends. The shape's thread waits for its tasks in poolWait, where it only runs
+tasks and shapes with counters of their own and charges its running stage under the same lock before each one(see
+instrumentScope), so while the tasks run every change to the shape's counters is made under the lock*/
+inline std::function<void()> instrumentWrap(const std::function<void()> &task)
+{
+    instrumentCounters *parent = instrumentState().counters;
+    if(parent == NULL)
+        return task;
+    return [parent, task]()
+    {
+        instrumentCounters counters;
+        instrumentScope scope(&counters, parent);
+        task();
+    };
+}
+
+#ifdef GREENS_INSTRUMENT
+#define INSTRUMENT_COUNT(counter, amount) instrumentAdd(INSTRUMENT_##counter, (amount))
+#define INSTRUMENT_STAGE(stage) instrumentTimer instrumentStageTimer(INSTRUMENT_STAGE_##stage)
+#define INSTRUMENT_SHAPE(name) instrumentShape instrumentShapeScope(name)
+#define INSTRUMENT_WRAP(task) task = instrumentWrap(task)
+#else
+#define INSTRUMENT_COUNT(counter, amount) ((void)0)
+#define INSTRUMENT_STAGE(stage) ((void)0)
+#define INSTRUMENT_SHAPE(name) ((void)0)
+#define INSTRUMENT_WRAP(task) ((void)0)
+#endif
+
+/*Function to ask for a report of every shape computed from now on, written to path when the program exits. Returns false
+if the program was built without -DGREENS_INSTRUMENT, there is nothing to report then*/
+inline bool instrumentProfile(const char *path)
+{
+#ifdef GREENS_INSTRUMENT
+    instrumentLog &log = instrumentReport();//Constructed before the exit handler is registered, so it outlives it
+    log.path = path;
+    atexit(instrumentWrite);
+    return true;
+#else
+    fprintf(stderr, "Warning: --profile needs a build with -DGREENS_INSTRUMENT, no report is written\n");
+    (void)path;
+    return false;
+#endif
+}
+
+//Function to write the report to the path given to instrumentProfile, JSON if it ends in .json and CSV otherwise
+inline void instrumentWrite()
+{
+    instrumentLog &log = instrumentReport();
+    std::lock_guard<std::mutex> guard(log.lock);
+    if(log.path.empty())
+        return;
+    FILE *out = fopen(log.path.c_str(), "w");
+    if(out == NULL)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", log.path.c_str());
+        return;
+    }
+    bool json = log.path.size() >= 5 && log.path.compare(log.path.size() - 5, 5, ".json") == 0;
+    size_t r;
+    int i;
+    if(json)
+        fprintf(out, "[\n");
+    else
+    {
+        fprintf(out, "shape");
+        for(i = 0; i < INSTRUMENT_NUM_COUNTERS; i++)
+            fprintf(out, ",%s", INSTRUMENT_COUNTER_NAMES[i]);
+        for(i = 0; i < INSTRUMENT_NUM_STAGES; i++)
+            fprintf(out, ",%s_s", INSTRUMENT_STAGE_NAMES[i]);
+        fprintf(out, ",total_s\n");
+    }
+    for(r = 0; r < log.records.size(); r++)
+    {
+        const instrumentRecord &record = log.records[r];
+        std::string name;
+        size_t c;
+        for(c = 0; c < record.name.size(); c++)//Quotes are doubled in CSV, JSON escapes them, backslashes and control characters
+        {
+            if(json && (unsigned char)record.name[c] < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned)(unsigned char)record.name[c]);
+                name += code;
+                continue;
+            }
+            if(record.name[c] == '"' || (json && record.name[c] == '\\'))
+                name += json ? '\\' : '"';
+            name += record.name[c];
+        }
+        fprintf(out, json ? "  {\"shape\": \"%s\"" : "\"%s\"", name.c_str());
+        for(i = 0; i < INSTRUMENT_NUM_COUNTERS; i++)
+            fprintf(out, json ? ", \"%s\": %llu" : "%.0s,%llu", INSTRUMENT_COUNTER_NAMES[i], record.counters.counts[i]);
+        if(json)
+            fprintf(out, ", \"seconds\": {");
+        for(i = 0; i < INSTRUMENT_NUM_STAGES; i++)
+            fprintf(out, json ? "%s\"%s\": %.9f" : "%s%.0s%.9f", (json && i == 0) ? "" : (json ? ", " : ","), INSTRUMENT_STAGE_NAMES[i], record.counters.seconds[i]);
+        fprintf(out, json ? ", \"total\": %.9f}}%s\n" : ",%.9f\n", record.seconds, r + 1 < log.records.size() ? "," : "");
+    }
+    if(json)
+        fprintf(out, "]\n");
+    fclose(out);
+}
+
+#endif
@@ -0,0 +1,400 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Interval - interval arithmetic over the expression tree of f(x,y)(see ExpressionTree.hpp). evalInterval takes a box
+[x0,x1]x[y0,y1] and gives an interval that is guaranteed to hold f(x,y) for every point of the box, so a search can throw
+away a whole box as soon as the interval does not hold 0: f has no zero there and no boundary passes through it.
+Every node turns the intervals of its operands into the interval of its own value. Bounds are rounded outward(one ulp
+for + - * /, a few ulps for the math library), non-monotone functions use their extrema inside the interval, and
+anything that cannot be bounded tightly(division by an interval holding 0, poles of tan...) becomes [-inf,inf]. The
+enclosure is never too small, but may be wider than the true range of f, more so for large boxes and for expressions
+using x or y many times. Points where f is undefined(log of a negative number...) are left out, an interval with no
+defined point is empty and holds no zero.
+    exprTree tree;
+    parseTree("x*x+y*y-4", tree);
+    interval f = evalInterval(tree, interval{0.0, 1.0}, interval{0.0, 1.0});//Holds [-4,-2]
+    if(!intervalHoldsZero(f))
+        ...no boundary in the box...*/
+
+#ifndef INTERVAL_HPP
+#define INTERVAL_HPP
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+#include "ExpressionTree.hpp"
+
+/*****************************Structure Definitions**************************/
+//Closed interval [lo,hi], empty if both bounds are NaN
+struct interval {
+    double lo;
+    double hi;
+};
+
+const int INTERVAL_LIBM_ULPS = 4;//Bounds from the math library are widened this much, its results are not correctly rounded
+
+/**********************Function Declarations**********************************/
+interval intervalEntire();//Function to obtain [-inf,inf]
+interval intervalEmpty();//Function to obtain the empty interval
+bool intervalIsEmpty(const interval &);//Function to determine if an interval is empty
+bool intervalHoldsZero(const interval &);//Function to determine if 0 is in an interval
+interval intervalWiden(double, double, int);//Function to round the bounds of an interval outward
+interval intervalPeriodic(const interval &, double (*)(double), double, double);//Function to bound sin or cos
+interval intervalPow(const interval &, const interval &);//Function to bound a^b
+interval evalInterval(const exprTree &, const interval &, const interval &);//Function to bound f over a box
+bool boxMayHoldZero(const exprTree &, double, double, double, double);//Function to determine if f may be 0 in a box
+
+//Function to obtain [-inf,inf]
+inline interval intervalEntire()
+{
+    interval r = {-HUGE_VAL, HUGE_VAL};
+    return r;
+}
+
+//Function to obtain the empty interval
+inline interval intervalEmpty()
+{
+    interval r = {NAN, NAN};
+    return r;
+}
+
+//Function to determine if an interval is empty
+inline bool intervalIsEmpty(const interval &a)
+{
+    return std::isnan(a.lo);
+}
+
+//Function to determine if 0 is in an interval, false for the empty interval
+inline bool intervalHoldsZero(const interval &a)
+{
+    return a.lo <= 0.0 && a.hi >= 0.0;
+}
+
+/*Function to round the bounds lo and hi outward by at least ulps units in the last place. Moving a bound by
+|bound| * ulps * DBL_EPSILON(plus a tiny amount for bounds near 0) is never less than ulps units in the last place, and is
+much faster than stepping with nextafter*/
+inline interval intervalWiden(double lo, double hi, int ulps)
+{
+    interval r;
+    r.lo = lo - (fabs(lo) * (ulps * DBL_EPSILON) + ulps * DBL_MIN);
+    r.hi = hi + (fabs(hi) * (ulps * DBL_EPSILON) + ulps * DBL_MIN);
+    return r;
+}
+
+/*Function to bound sin or cos(function) over a. The function is 1 at maxPhase + 2k pi and -1 at minPhase + 2k pi, between
+them it is monotone, so the bounds are its values at the ends of a unless an extremum lies in a. The search for extrema
+is done over a slightly wider interval, finding one too many only makes the bound looser*/
+inline interval intervalPeriodic(const interval &a, double (*function)(double), double maxPhase, double minPhase)
+{
+    if(!(a.hi - a.lo < 2.0 * M_PI) || fabs(a.lo) > 1e12 || fabs(a.hi) > 1e12)
+    {
+        interval r = {-1.0, 1.0};
+        return r;
+    }
+    double slack = 1e-12 * (1.0 + std::max(fabs(a.lo), fabs(a.hi)));
+    double lo = a.lo - slack, hi = a.hi + slack;
+    double fLo = function(a.lo), fHi = function(a.hi);
+    interval r = intervalWiden(std::min(fLo, fHi), std::max(fLo, fHi), INTERVAL_LIBM_ULPS);
+    if(floor((hi - maxPhase) / (2.0 * M_PI)) >= ceil((lo - maxPhase) / (2.0 * M_PI)))
+        r.hi = 1.0;
+    if(floor((hi - minPhase) / (2.0 * M_PI)) >= ceil((lo - minPhase) / (2.0 * M_PI)))
+        r.lo = -1.0;
+    r.lo = std::max(r.lo, -1.0);
+    r.hi = std::min(r.hi, 1.0);
+    return r;
+}
+
+/*Function to bound a^b. An integer exponent is exact for every base: odd powers are monotone, even powers have their
+minimum at 0. Any other exponent is only defined for bases >= 0, where a^b = exp(b ln(a)) is monotone in a and in b
+separately, so its bounds are at the corners of the box*/
+inline interval intervalPow(const interval &a, const interval &b)
+{
+    double lo, hi;
+    if(b.lo == b.hi && b.lo == floor(b.lo))
+    {
+        double n = b.lo;
+        bool odd = fmod(n, 2.0) != 0.0;
+        if(n == 0.0)
+        {
+            interval r = {1.0, 1.0};
+            return r;
+        }
+        if(n < 0.0 && a.lo <= 0.0 && a.hi >= 0.0)//Pole at 0
+            return intervalEntire();
+        double pLo = pow(a.lo, n), pHi = pow(a.hi, n);
+        if(odd)//Increasing for n > 0, decreasing on each side of 0 for n < 0
+        {
+            lo = std::min(pLo, pHi);
+            hi = std::max(pLo, pHi);
+        }
+        else if(a.lo >= 0.0 || a.hi <= 0.0)
+        {
+            lo = std::min(pLo, pHi);
+            hi = std::max(pLo, pHi);
+        }
+        else//n > 0, a holds 0
+        {
+            lo = 0.0;
+            hi = std::max(pLo, pHi);
+        }
+        interval r = intervalWiden(lo, hi, INTERVAL_LIBM_ULPS);
+        if(!odd && r.lo < 0.0)
+            r.lo = 0.0;
+        return r;
+    }
+    if(a.hi < 0.0)
+    {
+        if(b.lo == b.hi)//Non-integer power of a negative number
+            return intervalEmpty();
+        return intervalEntire();//b holds integers, any sign is possible
+    }
+    if(a.lo < 0.0 && b.lo != b.hi)
+        return intervalEntire();
+    double base = std::max(a.lo, 0.0);//Negative bases with a non-integer exponent are undefined
+    double corners[4] = {pow(base, b.lo), pow(base, b.hi), pow(a.hi, b.lo), pow(a.hi, b.hi)};
+    lo = *std::min_element(corners, corners + 4);
+    hi = *std::max_element(corners, corners + 4);
+    interval r = intervalWiden(lo, hi, INTERVAL_LIBM_ULPS);
+    r.lo = std::max(r.lo, 0.0);
+    return r;
+}
+
+/*Function to bound f over the box x by y with one pass over the tree, the same postorder loop evalDual uses. Returns an
+interval that holds f(x,y) for every point of the box where f is defined*/
+inline interval evalInterval(const exprTree &tree, const interval &x, const interval &y)
+{
+    interval stackValues[64];//Most boundaries are small, only allocate for large trees
+    char stackUndefined[64];
+    std::vector<interval> heapValues;
+    std::vector<char> heapUndefined;
+    interval *v = stackValues;
+    char *undefined = stackUndefined;//Set for nodes that may be undefined(NaN) at some points of the box
+    if(tree.nodes.empty())
+        return intervalEntire();
+    if(tree.nodes.size() > 64)
+    {
+        heapValues.resize(tree.nodes.size());
+        heapUndefined.resize(tree.nodes.size());
+        v = &heapValues[0];
+        undefined = &heapUndefined[0];
+    }
+    size_t i;
+    for(i = 0; i < tree.nodes.size(); i++)
+    {
+        const exprNode &node = tree.nodes[i];
+        interval &r = v[i];
+        const interval &p = v[node.left < 0 ? i : node.left];//Operands, only meaningful for nodes that have them
+        const interval &q = v[node.right < 0 ? i : node.right];
+        bool unary = node.left >= 0 && node.right < 0, binary = node.right >= 0;
+        char &partial = undefined[i];
+        partial = (node.left >= 0 && undefined[node.left]) || (node.right >= 0 && undefined[node.right]);
+        if(node.type == NODE_MIN || node.type == NODE_MAX)//Where one operand is undefined f may be the other one
+        {
+            if(intervalIsEmpty(p) || intervalIsEmpty(q))
+            {
+                r = intervalIsEmpty(p) ? q : p;
+                partial = true;
+                continue;
+            }
+        }
+        else if(node.type == NODE_POW && q.lo == 0.0 && q.hi == 0.0)//a^0 = 1, even where a is undefined
+        {
+            r.lo = r.hi = 1.0;
+            continue;
+        }
+        else if(((unary || binary) && intervalIsEmpty(p)) || (binary && intervalIsEmpty(q)))
+        {
+            r = intervalEmpty();
+            continue;
+        }
+        bool empty = false;//Set if no point of the operands is in the domain
+        double lo, hi;
+        switch(node.type)
+        {
+            case NODE_CONSTANT: r.lo = r.hi = node.value; break;
+            case NODE_X: r = x; break;
+            case NODE_Y: r = y; break;
+            case NODE_ADD: r = intervalWiden(p.lo + q.lo, p.hi + q.hi, 1); break;
+            case NODE_SUB: r = intervalWiden(p.lo - q.hi, p.hi - q.lo, 1); break;
+            case NODE_NEG: r.lo = -p.hi; r.hi = -p.lo; break;
+            case NODE_MUL:
+            {
+                double products[4] = {p.lo * q.lo, p.lo * q.hi, p.hi * q.lo, p.hi * q.hi};
+                if(std::isnan(products[0] + products[1] + products[2] + products[3]))//0 * inf is 0 here, an infinite bound stands for a large value
+                {
+                    products[0] = (p.lo == 0.0 || q.lo == 0.0) ? 0.0 : products[0];
+                    products[1] = (p.lo == 0.0 || q.hi == 0.0) ? 0.0 : products[1];
+                    products[2] = (p.hi == 0.0 || q.lo == 0.0) ? 0.0 : products[2];
+                    products[3] = (p.hi == 0.0 || q.hi == 0.0) ? 0.0 : products[3];
+                }
+                r = intervalWiden(std::min(std::min(products[0], products[1]), std::min(products[2], products[3])),
+                                  std::max(std::max(products[0], products[1]), std::max(products[2], products[3])), 1);
+                break;
+            }
+            case NODE_DIV:
+            {
+                if(q.lo <= 0.0 && q.hi >= 0.0)
+                {
+                    r = intervalEntire();
+                    partial = true;//0/0
+                    break;
+                }
+                double quotients[4] = {p.lo / q.lo, p.lo / q.hi, p.hi / q.lo, p.hi / q.hi};
+                r = intervalWiden(*std::min_element(quotients, quotients + 4), *std::max_element(quotients, quotients + 4), 1);
+                break;
+            }
+            case NODE_MOD://fmod has the sign of a and is smaller than |b| in magnitude, it is a itself while |a| < |b|
+            {
+                double bMax = std::max(fabs(q.lo), fabs(q.hi));
+                double bMin = (q.lo <= 0.0 && q.hi >= 0.0) ? 0.0 : std::min(fabs(q.lo), fabs(q.hi));
+                partial = partial || bMin == 0.0;
+                if(std::max(fabs(p.lo), fabs(p.hi)) < bMin)
+                    r = p;
+                else
+                {
+                    r.lo = p.lo >= 0.0 ? 0.0 : std::max(p.lo, -bMax);
+                    r.hi = p.hi <= 0.0 ? 0.0 : std::min(p.hi, bMax);
+                }
+                break;
+            }
+            case NODE_POW:
+                r = intervalPow(p, q);
+                empty = intervalIsEmpty(r);
+                partial = partial || (p.lo < 0.0 && !(q.lo == q.hi && q.lo == floor(q.lo)));//Negative base, non-integer exponent
+                break;
+            case NODE_ATAN2://Quadrants of the box: y >= 0 gives [0,pi], y <= 0 gives [-pi,0], x > 0 gives [-pi/2,pi/2]
+                lo = -M_PI;
+                hi = M_PI;
+                if(p.lo >= 0.0)
+                    lo = 0.0;
+                if(p.hi <= 0.0)
+                    hi = 0.0;
+                if(q.lo > 0.0)
+                {
+                    lo = std::max(lo, -M_PI_2);
+                    hi = std::min(hi, M_PI_2);
+                }
+                r = intervalWiden(lo, hi, INTERVAL_LIBM_ULPS);
+                break;
+            case NODE_HYPOT:
+            {
+                double aMin = (p.lo <= 0.0 && p.hi >= 0.0) ? 0.0 : std::min(fabs(p.lo), fabs(p.hi));
+                double bMin = (q.lo <= 0.0 && q.hi >= 0.0) ? 0.0 : std::min(fabs(q.lo), fabs(q.hi));
+                r = intervalWiden(hypot(aMin, bMin), hypot(std::max(fabs(p.lo), fabs(p.hi)), std::max(fabs(q.lo), fabs(q.hi))), INTERVAL_LIBM_ULPS);
+                r.lo = std::max(r.lo, 0.0);
+                break;
+            }
+            case NODE_MIN: r.lo = std::min(p.lo, q.lo); r.hi = std::min(p.hi, q.hi); break;
+            case NODE_MAX: r.lo = std::max(p.lo, q.lo); r.hi = std::max(p.hi, q.hi); break;
+            case NODE_SIN: r = intervalPeriodic(p, sin, M_PI_2, -M_PI_2); break;
+            case NODE_COS: r = intervalPeriodic(p, cos, 0.0, M_PI); break;
+            case NODE_TAN://Monotone between poles at pi/2 + k pi
+            {
+                double slack = 1e-12 * (1.0 + std::max(fabs(p.lo), fabs(p.hi)));
+                if(!(p.hi - p.lo < M_PI) || floor((p.hi + slack - M_PI_2) / M_PI) >= ceil((p.lo - slack - M_PI_2) / M_PI))
+                    r = intervalEntire();
+                else
+                    r = intervalWiden(tan(p.lo), tan(p.hi), INTERVAL_LIBM_ULPS);
+                break;
+            }
+            case NODE_ASIN: case NODE_ACOS://Defined on [-1,1]
+                lo = std::max(p.lo, -1.0);
+                hi = std::min(p.hi, 1.0);
+                partial = partial || lo != p.lo || hi != p.hi;
+                if(lo > hi)
+                    empty = true;
+                else if(node.type == NODE_ASIN)
+                    r = intervalWiden(asin(lo), asin(hi), INTERVAL_LIBM_ULPS);
+                else
+                    r = intervalWiden(acos(hi), acos(lo), INTERVAL_LIBM_ULPS);
+                break;
+            case NODE_ATAN: r = intervalWiden(atan(p.lo), atan(p.hi), INTERVAL_LIBM_ULPS); break;
+            case NODE_SINH: r = intervalWiden(sinh(p.lo), sinh(p.hi), INTERVAL_LIBM_ULPS); break;
+            case NODE_COSH://Minimum 1 at 0
+                if(p.lo >= 0.0)
+                    r = intervalWiden(cosh(p.lo), cosh(p.hi), INTERVAL_LIBM_ULPS);
+                else if(p.hi <= 0.0)
+                    r = intervalWiden(cosh(p.hi), cosh(p.lo), INTERVAL_LIBM_ULPS);
+                else
+                    r = intervalWiden(1.0, std::max(cosh(p.lo), cosh(p.hi)), INTERVAL_LIBM_ULPS);
+                r.lo = std::max(r.lo, 1.0);
+                break;
+            case NODE_TANH:
+                r = intervalWiden(tanh(p.lo), tanh(p.hi), INTERVAL_LIBM_ULPS);
+                r.lo = std::max(r.lo, -1.0);
+                r.hi = std::min(r.hi, 1.0);
+                break;
+            case NODE_EXP:
+                r = intervalWiden(exp(p.lo), exp(p.hi), INTERVAL_LIBM_ULPS);
+                r.lo = std::max(r.lo, 0.0);
+                break;
+            case NODE_LOG: case NODE_LOG10: case NODE_LOG2: case NODE_SQRT://Defined for a >= 0
+            {
+                if(p.hi < 0.0)
+                {
+                    empty = true;
+                    break;
+                }
+                partial = partial || p.lo < 0.0;
+                static double (*const functions[])(double) = {log, log10, log2, sqrt};//Same order as the node types
+                double (*function)(double) = functions[node.type - NODE_LOG];
+                r = intervalWiden(function(std::max(p.lo, 0.0)), function(p.hi), INTERVAL_LIBM_ULPS);
+                if(node.type == NODE_SQRT)
+                    r.lo = std::max(r.lo, 0.0);
+                break;
+            }
+            case NODE_ABS:
+                if(p.lo >= 0.0)
+                    r = p;
+                else if(p.hi <= 0.0)
+                {
+                    r.lo = -p.hi;
+                    r.hi = -p.lo;
+                }
+                else
+                {
+                    r.lo = 0.0;
+                    r.hi = std::max(-p.lo, p.hi);
+                }
+                break;
+            case NODE_SGN:
+                r.lo = (p.lo > 0.0) ? 1.0 : ((p.lo < 0.0) ? -1.0 : 0.0);
+                r.hi = (p.hi > 0.0) ? 1.0 : ((p.hi < 0.0) ? -1.0 : 0.0);
+                break;
+            default: r = intervalEntire(); break;
+        }
+        if(empty)
+            r = intervalEmpty();
+        else if(std::isnan(r.lo) || std::isnan(r.hi))//inf - inf and the like, nothing is known
+        {
+            r = intervalEntire();
+            partial = true;
+        }
+        else if(node.type == NODE_MIN || node.type == NODE_MAX)
+        {
+            const interval &other = undefined[node.left] ? q : p;//Taken where the other operand is undefined
+            if(undefined[node.left] || undefined[node.right])
+            {
+                r.lo = std::min(r.lo, other.lo);
+                r.hi = std::max(r.hi, other.hi);
+            }
+            if(undefined[node.left] && undefined[node.right])
+            {
+                r.lo = std::min(r.lo, std::min(p.lo, q.lo));
+                r.hi = std::max(r.hi, std::max(p.hi, q.hi));
+            }
+        }
+    }
+    return v[tree.nodes.size() - 1];
+}
+
+//Function to determine if f may be 0 somewhere in the box [x0,x1]x[y0,y1], false means f has no zero in the box
+inline bool boxMayHoldZero(const exprTree &tree, double x0, double x1, double y0, double y1)
+{
+    interval x = {x0, x1}, y = {y0, y1};
+    return intervalHoldsZero(evalInterval(tree, x, y));
+}
+
+#endif
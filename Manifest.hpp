@@ -0,0 +1,224 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Manifest - batch mode shared by the executables. A manifest lists many shapes, each program computes all of them in
+one run(so the compiled expressions are reused from shape to shape) and writes one result record per shape. Shapes are
+tasks of a work-stealing pool of worker threads, each keeps its own(thread_local) compiled expressions for the whole batch.
+Manifest format, one item per line, everything after # is a comment:
+    shape <name>                    starts a new shape
+    segment <numbers> <function>    one functionStruct, the numbers depend on the program:
+                                      Hyades: startx starty endx endy xmin xmax ymin ymax
+                                      Cygnus, MidnightOil: startx starty endx endy
+    region <numbers> <function>     Hyades, Cygnus: xmin xmax ymin ymax, the area where f(x,y) < 0 in the box, every
+                                    component and hole found without start points(see ZeroSet.hpp), alone in its shape
+    point <x> <y>                   Pleiades: one point of the shape
+    file <path>                     Pleiades: points of the shape from a text file
+    binary <path>                   Pleiades: points of the shape from a raw float64 x,y file
+Results are written as CSV: shape,area,points,seconds,error*/
+
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include "Scheduler.hpp"
+
+/*****************************Structure Definitions**************************/
+//One line of a shape: keyword and the rest of the line
+struct manifestLine {
+    std::string keyword;
+    std::string rest;
+    int line;//Line number in the manifest, for error messages
+};
+
+//One shape of a manifest
+struct manifestShape {
+    std::string name;
+    std::vector<manifestLine> lines;
+    int line;//Line number of "shape", for error messages
+};
+
+//Result record of one shape
+struct shapeResult {
+    std::string name;
+    bool ok;//False if the shape could not be computed, error says why
+    double area;
+    size_t points;//Number of points of the boundary polygon
+    double seconds;//Time taken by this shape
+    std::string error;
+};
+
+/**********************Function Declarations**********************************/
+bool parseManifestLine(std::string, int, manifestLine &);//Function to split one manifest line into keyword and rest
+bool readManifest(const std::string &, std::vector<manifestShape> &, std::string &);//Function to read the shapes of a manifest
+bool takeNumbers(const std::string &, int, double[], std::string &);//Function to read the leading numbers of a line
+std::string csvField(const std::string &);//Function to quote a CSV field if needed
+std::string formatResult(const shapeResult &);//Function to format one result record
+bool writeResults(const char *, const std::vector<shapeResult> &);//Function to write the result records
+int runBatch(const char *, const char *, unsigned, shapeResult (*)(const manifestShape &));//Function to compute every shape of a manifest
+
+/*Function to split one manifest line into keyword and rest, comments and surrounding whitespace removed. Returns false
+for a blank(or comment only) line*/
+inline bool parseManifestLine(std::string text, int lineNumber, manifestLine &line)
+{
+    size_t hash = text.find('#');
+    if(hash != std::string::npos)
+        text.erase(hash);
+    size_t begin = text.find_first_not_of(" \t\r");
+    if(begin == std::string::npos)//Blank line
+        return false;
+    size_t end = text.find_last_not_of(" \t\r");
+    size_t split = text.find_first_of(" \t", begin);
+    line.keyword = text.substr(begin, (split == std::string::npos || split > end) ? end + 1 - begin : split - begin);
+    line.rest = (split == std::string::npos || split > end) ? "" : text.substr(split + 1, end - split);
+    line.rest.erase(0, line.rest.find_first_not_of(" \t"));
+    line.line = lineNumber;
+    return true;
+}
+
+//Function to read the shapes of a manifest. Returns false and sets error if the file cannot be read or is malformed
+inline bool readManifest(const std::string &path, std::vector<manifestShape> &shapes, std::string &error)
+{
+    std::ifstream file(path.c_str());
+    if(!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string text;
+    int lineNumber = 0;
+    while(std::getline(file, text))
+    {
+        lineNumber++;
+        manifestLine line;
+        if(!parseManifestLine(text, lineNumber, line))
+            continue;
+        if(line.keyword == "shape")
+        {
+            manifestShape shape;
+            shape.name = line.rest.empty() ? "shape" + std::to_string(shapes.size() + 1) : line.rest;
+            shape.line = lineNumber;
+            shapes.push_back(shape);
+        }
+        else if(shapes.empty())
+        {
+            error = "line " + std::to_string(lineNumber) + ": \"" + line.keyword + "\" before the first shape";
+            return false;
+        }
+        else
+            shapes.back().lines.push_back(line);
+    }
+    return true;
+}
+
+/*Function to read the first count numbers of a line, the rest of the line(trimmed) goes to remainder. Returns false if
+there are fewer than count numbers*/
+inline bool takeNumbers(const std::string &text, int count, double numbers[], std::string &remainder)
+{
+    INSTRUMENT_STAGE(PARSE);
+    const char *p = text.c_str();
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        char *stop;
+        numbers[i] = strtod(p, &stop);
+        if(stop == p || (*stop != '\0' && *stop != ' ' && *stop != '\t'))//Not a whole number
+            return false;
+        p = stop;
+    }
+    while(*p == ' ' || *p == '\t')
+        p++;
+    remainder = p;
+    return true;
+}
+
+//Function to quote a CSV field if it contains a comma, quote or newline
+inline std::string csvField(const std::string &field)
+{
+    if(field.find_first_of(",\"\n") == std::string::npos)
+        return field;
+    std::string quoted = "\"";
+    size_t i;
+    for(i = 0; i < field.size(); i++)
+    {
+        if(field[i] == '"')
+            quoted += '"';
+        quoted += field[i];
+    }
+    return quoted + "\"";
+}
+
+//Function to format one result record as a CSV line(with newline)
+inline std::string formatResult(const shapeResult &r)
+{
+    char numbers[96];
+    if(r.ok)
+        snprintf(numbers, sizeof(numbers), ",%.15g,%zu,%.6f,", r.area, r.points, r.seconds);
+    else
+        snprintf(numbers, sizeof(numbers), ",,,%.6f,", r.seconds);
+    return csvField(r.name) + numbers + (r.ok ? "" : csvField(r.error)) + "\n";
+}
+
+//Function to write the result records as CSV to path, or to stdout if path is NULL. Returns false if it cannot be written
+inline bool writeResults(const char *path, const std::vector<shapeResult> &results)
+{
+    FILE *out = path ? fopen(path, "w") : stdout;
+    if(out == NULL)
+        return false;
+    fprintf(out, "shape,area,points,seconds,error\n");
+    size_t i;
+    for(i = 0; i < results.size(); i++)
+        fputs(formatResult(results[i]).c_str(), out);
+    if(path)
+        fclose(out);
+    return true;
+}
+
+/*Function to compute every shape of the manifest at manifestPath with computeShape on numThreads threads(0 uses every
+core) and write the results to resultPath(stdout if NULL). Each shape is a task of a work-stealing pool(see
+Scheduler.hpp), which is the active pool while the batch runs so computeShape can split a shape into smaller tasks.
+computeShape fills in ok, area, points and error. Returns the exit status for main*/
+inline int runBatch(const char *manifestPath, const char *resultPath, unsigned numThreads, shapeResult (*computeShape)(const manifestShape &))
+{
+    std::vector<manifestShape> shapes;
+    std::string error;
+    if(!readManifest(manifestPath, shapes, error))
+    {
+        fprintf(stderr, "Error: %s\n", error.c_str());
+        return 1;
+    }
+    std::vector<shapeResult> results(shapes.size());
+    workStealingPool pool;
+    poolStart(pool, numThreads);
+    activePool() = &pool;//computeShape may split a shape into more tasks
+    taskGroup group;
+    size_t k;
+    for(k = 0; k < shapes.size(); k++)
+    {
+        poolSpawn(pool, group, [&shapes, &results, computeShape, k]()
+        {
+            INSTRUMENT_SHAPE(shapes[k].name);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            results[k] = computeShape(shapes[k]);
+            results[k].name = shapes[k].name;
+            results[k].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+    }
+    poolWait(pool, group);//Calling thread works too
+    activePool() = NULL;
+    poolStop(pool);
+    if(!writeResults(resultPath, results))
+    {
+        fprintf(stderr, "Error: cannot write %s\n", resultPath);
+        return 1;
+    }
+    return 0;
+}
+
+#endif
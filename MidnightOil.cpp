@@ -10,11 +10,25 @@ in R^2 using a variation of Green's Theorem*/
 #include <iostream>
 #include <vector>
 #include <string>
-#include <ctime>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <thread>
 #include "exprtk.hpp"
+#include "PolygonArea.h"
+#include "Manifest.hpp"
+#include "Daemon.hpp"
+#include "ResultCache.hpp"
+#include "Scheduler.hpp"
+#include "Instrument.hpp"
+#include "TraceSink.hpp"
 using namespace std;
 
-double DELTA = 0.05;//Step Size
+double DELTA = 0.05;//Initial step size, adapted to the curvature as the traversal goes
+double TOLERANCE = 0.0001;//Max distance allowed between the boundary polygon and the curve
+double MIN_STEP = 0.000001;//Smallest step the controller may take
+double MAX_STEP = 1.0;//Largest step the controller may take
 double EPSILON = 0.00001;//Epsilon needed for operations with doubles
 
 /*****************************Structure Definitions**************************/
@@ -38,101 +52,272 @@ struct functionStruct {
     point end;//End point of traversal
 };
 
+/*Segments are traced in parallel as tasks of a work-stealing pool(see Scheduler.hpp). The compiled expressions below are
+thread_local, so the workers share nothing until the per-segment point lists are stitched together in order*/
+unsigned NUM_THREADS = 0;//Number of worker threads, 0 uses every core
+resultMemo memo;//Shapes already computed in batch and daemon mode, see ResultCache.hpp
+
 //Type definitions from ExprTk library
 typedef exprtk::symbol_table<double> symbol_table_t;
 typedef exprtk::expression<double> expression_t;
 typedef exprtk::parser<double> parser_t;
-expression_t expression;//Setting up evaluation infrastructure-no need to do this multiple times
-parser_t parser;
+thread_local parser_t parser;//Setting up evaluation infrastructure-no need to do this multiple times
+thread_local symbol_table_t symbol_table;//Shared by every compiled expression, binds x to xVar
+thread_local double xVar;//Variable read by the compiled expressions
+thread_local unordered_map<string, expression_t> expressionCache;//Each function string is compiled exactly once
 
 /**********************Function Declarations**********************************/
-void printPoint();//Function to print a strung representation of a point
-vector<point> dfs(functionStruct, vector<point>);//Function to obtain points along boundary of shape
-double eval(string, double);//Function to evaluate the function at a point (x,y)
-double calcArea(vector<point>);//Function to calculate area
-
-//Function to cprint a string representation of a point
-void printPoint(point point1)
-{
-  printf("(%lf, %lf) ", point1.x, point1.y);
-}
+void dfs(const functionStruct &, vector<point> &);//Function to obtain points along boundary of shape
+vector<point> traceSegments(const vector<functionStruct> &);//Function to trace every segment in parallel and stitch the results
+expression_t &getExpression(const string &);//Function to obtain the compiled expression for f(x)
+bool validFunction(const string &, string &);//Function to determine if ExprTk can compile f(x)
+double eval(const string &, double);//Function to evaluate the function at a point (x,y)
+double calcArea(const vector<point> &);//Function to calculate area
+string shapeKey(const vector<functionStruct> &);//Function to build the memo key of a shape
+shapeResult computeShape(const manifestShape &);//Function to calculate the area of one shape of a batch manifest
 
 /*
 Given function f(x) = 0 for segment of boundary of shape, obtain
 points (x,y) along boundary of shape to give to then calculate area.
+The step in x is adapted to the curvature of f: the distance between f at the middle of a step
+and the chord of the step is f''*step^2/8, so steps whose chord is further than TOLERANCE from the curve
+are redone with half the step and the next step is scaled so its chord error is about TOLERANCE.
+A constantx segment is a straight line and only needs its end point. The points are appended to orderedPoints1. If the
+trace sink is open(see TraceSink.hpp) every point is recorded there.
 */
-vector<point> dfs(functionStruct fs1, vector<point> orderedPoints1)
+void dfs(const functionStruct &fs1, vector<point> &orderedPoints1)
 {
-    if((fs1.start.x > fs1.end.x && DELTA > 0) || (fs1.start.x < fs1.end.x && DELTA < 0))
-      DELTA *= -1;
+    INSTRUMENT_STAGE(TRACE);
     point curPoint, end, next;
-    int constantx = 0;
     curPoint = fs1.start;
     end = fs1.end;
-    if(fs1.function.compare("constantx") == 0)
-        constantx = 1;
-    while(!(curPoint == end))//Doing traversal
+    bool trace = traceEnabled();
+    uint64_t path = trace ? traceBegin() : 0;
+    if(fs1.function.compare("constantx") == 0)//Vertical line, the chord is exact
     {
-      if(constantx == 0)
+      if(trace)
       {
-        next.x = curPoint.x + DELTA;//Obtain next search point
-        next.y = eval(fs1.function, next.x);
+        tracePoint(path, end.x, end.y);
+        traceFlush();
       }
-      else
+      INSTRUMENT_COUNT(STEPS, 1);
+      orderedPoints1.push_back(end);
+      return;
+    }
+    double direction = (end.x > curPoint.x) ? 1.0 : -1.0;
+    double step = abs(DELTA);
+    while(direction * (end.x - curPoint.x) > EPSILON)//Doing traversal
+    {
+      step = min(step, abs(end.x - curPoint.x));//Last step lands exactly on end.x
+      next.x = curPoint.x + direction * step;//Obtain next search point
+      next.y = eval(fs1.function, next.x);
+      double chordError = abs(eval(fs1.function, curPoint.x + direction * step / 2) - (curPoint.y + next.y) / 2);
+      if(chordError > TOLERANCE && step > MIN_STEP)//Step too long for this bend, redo it
       {
-        if((fs1.start.y > fs1.end.y && DELTA > 0) || (fs1.start.y < fs1.end.y && DELTA < 0))
-          DELTA *= -1;
-        next.x = curPoint.x;
-        next.y = curPoint.y + DELTA;
+        step = max(step / 2, MIN_STEP);
+        continue;
       }
-      printPoint(next);
+      if(trace)
+        tracePoint(path, next.x, next.y);
+      INSTRUMENT_COUNT(STEPS, 1);
       orderedPoints1.push_back(next);//Add to storage
       curPoint = next;
+      double scale = (chordError > 0.0) ? 0.9 * sqrt(TOLERANCE / chordError) : 2.0;
+      step = min(MAX_STEP, max(MIN_STEP, step * min(2.0, scale)));//Grow by at most 2x per step
     }
-    return orderedPoints1;
+    if(trace)
+      traceFlush();//The path goes to the writer before this thread moves on
 }
 
-//Evaluate a function f(x) at x = 4, return value of function at point (x,y)
-double eval(string function, double a)
+/*Function to trace every segment of the boundary. Segments are independent given their start and end points, so each
+one is a task of the active work-stealing pool(idle batch workers steal the segments of an expensive shape). Without a
+pool(daemon workers) the segments are traced one after another. The point lists are stitched in segment order*/
+vector<point> traceSegments(const vector<functionStruct> &segments)
 {
-  symbol_table_t symbol_table;
-  symbol_table.add_constants();
-  symbol_table.add_variable("x", a);
-  expression.register_symbol_table(symbol_table);
-  if(!(parser.compile(function, expression)))//If f(x,y) is not a valid expression that can be evaluated by ExprTk
+    vector< vector<point> > results(segments.size());
+    workStealingPool *pool = activePool();
+    size_t k;
+    if(pool == NULL || segments.size() == 1)//Nothing to split onto, or nothing to split
+    {
+      for(k = 0; k < segments.size(); k++)
+        dfs(segments[k], results[k]);
+    }
+    else
+    {
+      taskGroup group;
+      for(k = 0; k < segments.size(); k++)
+        poolSpawn(*pool, group, [&segments, &results, k]() { dfs(segments[k], results[k]); });
+      poolWait(*pool, group);//Traces segments here too
+    }
+    vector<point> orderedPoints;
+    size_t total = 0;
+    for(k = 0; k < results.size(); k++)
+      total += results[k].size();
+    orderedPoints.reserve(total);
+    for(k = 0; k < results.size(); k++)//Stitch in order
+      orderedPoints.insert(orderedPoints.end(), results[k].begin(), results[k].end());
+    return orderedPoints;
+}
+
+/*Function to obtain the compiled expression for f(x). The function string is parsed and compiled the first
+time it is seen(see validFunction), afterwards the cached expression is returned so evaluating only costs an assignment
+and value(). Ends the program with status 1 if ExprTk cannot compile the function*/
+expression_t &getExpression(const string &function)
+{
+  unordered_map<string, expression_t>::iterator it = expressionCache.find(function);
+  if(it != expressionCache.end())//Already compiled
+    return it->second;
+  string error;
+  if(!validFunction(function, error))
   {
-    printf("Error: %s\tExpression: %s\n", parser.error().c_str(), function.c_str());
-    exit(0);
+    fprintf(stderr, "%s\n", error.c_str());
+    exit(1);
   }
-  double result = expression.value();
-  return result;
+  return expressionCache[function];
 }
 
-/*Function that actually calculates area, given points along boundary of shape
-using variation of Green's Theorem*/
-double calcArea(vector<point> orderedPoints)
+/*Function to determine if ExprTk can compile f(x), without ending the program if it cannot: error is set to the ExprTk
+message. A valid function is compiled into the cache, so getExpression never fails for it afterwards*/
+bool validFunction(const string &function, string &error)
 {
-  double area = 0.0;
-  int idx = 0;//Index in vector
-  int numItr = 0;//Number of iterations(additions). Actual formula is defined using series
-  int size = orderedPoints.size();
-  while(numItr < size)
+  if(function.compare("constantx") == 0 || expressionCache.count(function))
+    return true;
+  INSTRUMENT_STAGE(COMPILE);
+  INSTRUMENT_COUNT(COMPILES, 1);
+  if(!symbol_table.symbol_exists("x"))//First compile, bind x to xVar
   {
-      if(numItr < size - 1)
-          area += ((orderedPoints[idx].x * orderedPoints[idx + 1].y) - (orderedPoints[idx].y * orderedPoints[idx + 1].x));
-      else
-          area += ((orderedPoints[idx].x * orderedPoints[0].y) - (orderedPoints[0].x * orderedPoints[idx].y));
-      idx++;
-      numItr++;
+    symbol_table.add_constants();
+    symbol_table.add_variable("x", xVar);
   }
-  if(area < 0)//Area cannot be negative
+  expression_t expression;
+  expression.register_symbol_table(symbol_table);
+  if(!(parser.compile(function, expression)))//If f(x) is not a valid expression that can be evaluated by ExprTk
   {
-      area *= -1;
+    error = "Error: " + parser.error() + "\tExpression: " + function;
+    return false;
   }
-  return (area / 2);
+  expressionCache[function] = expression;
+  return true;
 }
 
-int main() {
+//Evaluate a function f(x) at x = a, return value of function at point (x,y)
+double eval(const string &function, double a)
+{
+  expression_t &expression = getExpression(function);
+  xVar = a;
+  INSTRUMENT_COUNT(EVALUATIONS, 1);
+  return expression.value();
+}
+
+/*Function that actually calculates area, given points along boundary of shape
+using variation of Green's Theorem*/
+double calcArea(const vector<point> &orderedPoints)
+{
+  INSTRUMENT_STAGE(AREA);
+  if(orderedPoints.empty())
+    return 0.0;
+  return polygonArea(&orderedPoints[0].x, &orderedPoints[0].y, orderedPoints.size(), 2);
+}
+
+/*Function to build the memo key of a shape: the settings the step controller depends on, then every segment with its
+numbers printed exactly and its function without whitespace, in order*/
+string shapeKey(const vector<functionStruct> &segments)
+{
+    string key = "MidnightOil DELTA=" + memoNumber(DELTA) + " TOLERANCE=" + memoNumber(TOLERANCE) + " MIN_STEP=" + memoNumber(MIN_STEP);
+    key += " MAX_STEP=" + memoNumber(MAX_STEP) + " EPSILON=" + memoNumber(EPSILON);
+    size_t i;
+    for(i = 0; i < segments.size(); i++)
+    {
+      const functionStruct &fs1 = segments[i];
+      key += " | " + memoNumber(fs1.start.x) + " " + memoNumber(fs1.start.y) + " " + memoNumber(fs1.end.x) + " " + memoNumber(fs1.end.y);
+      key += " " + memoFunction(fs1.function);
+    }
+    return key;
+}
+
+/*Function to calculate the area of one shape of a batch manifest. Each line of the shape is
+"segment startx starty endx endy f(x)" where f(x) may be constantx. The segments are traced by traceSegments. A shape
+that is already in the memo is not traced again*/
+shapeResult computeShape(const manifestShape &shape)
+{
+    shapeResult result;
+    result.ok = false;
+    result.area = 0.0;
+    result.points = 0;
+    vector<functionStruct> segments;
+    size_t i;
+    for(i = 0; i < shape.lines.size(); i++)
+    {
+      const manifestLine &line = shape.lines[i];
+      functionStruct fs1;
+      double v[4];
+      if(line.keyword != "segment" || !takeNumbers(line.rest, 4, v, fs1.function) || fs1.function.empty())
+      {
+        result.error = "line " + to_string(line.line) + ": expected segment startx starty endx endy f(x)";
+        return result;
+      }
+      fs1.start.x = v[0];
+      fs1.start.y = v[1];
+      fs1.end.x = v[2];
+      fs1.end.y = v[3];
+      if(!validFunction(fs1.function, result.error))//A bad function fails this shape, not the whole batch
+        return result;
+      segments.push_back(fs1);
+    }
+    if(segments.empty())
+    {
+      result.error = "shape has no segments";
+      return result;
+    }
+    string key = shapeKey(segments);
+    memoEntry entry;
+    if(memoLookup(memo, key, false, entry))
+    {
+      result.ok = true;
+      result.area = entry.area;
+      result.points = entry.points;
+      return result;
+    }
+    vector<point> orderedPoints = traceSegments(segments);
+    result.ok = true;
+    result.area = calcArea(orderedPoints);
+    result.points = orderedPoints.size();
+    entry.area = result.area;
+    entry.points = result.points;
+    memoStore(memo, key, entry);
+    return result;
+}
+
+/*MidnightOil computes the cycle below, with --batch every shape of a manifest(see Manifest.hpp)
+or with --daemon shape requests from stdin or a Unix socket(see Daemon.hpp):
+MidnightOil --batch manifest.txt [results.csv]
+MidnightOil --daemon [socket path]
+Any of them can be preceded by these options:
+--memo dir to keep the results of computed shapes in dir across runs(see ResultCache.hpp)
+--profile report.csv(or .json) to write the counters and stage times of every shape, in a build with -DGREENS_INSTRUMENT(see Instrument.hpp)
+--trace trace.csv(or .bin) to record every boundary point found(see TraceSink.hpp)*/
+int main(int argc, char *argv[]) {
+    while(argc > 2)//Options, in any order
+    {
+      string option = argv[1];
+      if(option == "--memo")
+        memo.dir = argv[2];
+      else if(option == "--profile")
+        instrumentProfile(argv[2]);
+      else if(option == "--trace")
+      {
+        if(!traceOpen(argv[2]))
+          return 1;
+      }
+      else
+        break;
+      argc -= 2;
+      argv += 2;
+    }
+    if(argc > 2 && string(argv[1]) == "--batch")
+      return runBatch(argv[2], argc > 3 ? argv[3] : NULL, NUM_THREADS, computeShape);
+    if(argc > 1 && string(argv[1]) == "--daemon")
+      return runDaemon(argc > 2 ? argv[2] : NULL, NUM_THREADS, computeShape);
     functionStruct fs1, fs2, fs3, fs4;
     point start1, start2, start3, start4;
     vector<point> orderedPoints;
@@ -161,19 +346,19 @@ int main() {
     functionVector.push_back(fs2);
     functionVector.push_back(fs3);
     functionVector.push_back(fs4);
-    clock_t clk;
-    clk = clock();
-    int i;
-    for(i = 0; i < functionVector.size(); i++)//Do search
-    {
-      functionStruct fs1 = functionVector[i];
-      orderedPoints = dfs(fs1, orderedPoints);
-    }
+    INSTRUMENT_SHAPE("MidnightOil");
+    chrono::steady_clock::time_point clk = chrono::steady_clock::now();//Wall time, clock() would add up every thread
+    workStealingPool pool;
+    poolStart(pool, (unsigned)min((size_t)(NUM_THREADS ? NUM_THREADS : max(1u, thread::hardware_concurrency())), functionVector.size()));
+    activePool() = &pool;
+    orderedPoints = traceSegments(functionVector);//Do search
+    activePool() = NULL;
+    poolStop(pool);
     double work = calcArea(orderedPoints);//Calculate area
-    clk = clock() - clk;
+    double runtime = chrono::duration<double>(chrono::steady_clock::now() - clk).count();
     printf("The net work done by the engine is: %lf\n", work);
     printf("Size of vector: %lu\n", orderedPoints.size());
-    printf("Runtime: %lf\n", ((double)clk) / CLOCKS_PER_SEC);
+    printf("Runtime: %lf\n", runtime);
     /*double Qh, tCycle;
     printf("Enter the temperature of the energy absorbed by the engine to calculate efficiency:\n");
     scanf("%lf", &Qh);
@@ -0,0 +1,393 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*NativeKernel - boundary functions translated to C++ and compiled to machine code, for the functions that are evaluated
+billions of times. The expression tree of f(x,y)(see ExpressionTree.hpp) is written out as straight-line C++: every
+node becomes one value and its two partial derivatives, the same dual number pass evalDual makes, so the kernel gives f,
+df/dx and df/dy in one call with no interpreter in between. The source is compiled into a shared object with the local
+compiler($CXX, or c++), loaded with dlopen and kept by the 64 bit FNV-1a hash of the function string without
+whitespace. Files live in the kernel directory as greens_<hash>.cpp and greens_<hash>.so, so a function compiled once is
+loaded straight from disk by every later run. The function string is stored in the shared object and compared on load,
+two functions with the same hash just rebuild each other's file.
+Building takes a compiler run, so it happens on a background thread: nativeLookup returns at once, the interpreter is
+used until the kernel is ready. A traversal picks the kernel only when a segment starts(greensLatch in Greens.hpp), so
+one segment never mixes the two. A short ad-hoc run finishes on the interpreter, while shapes of a long batch or daemon
+run(and every run after the first) use the native kernel.
+    nativeEnable("kernels");//Turn native kernels on, off by default
+    nativeKernel *kernel = nativeLookup(function);//NULL if the function cannot be translated
+    if(kernel != NULL && kernel->state == NATIVE_READY)
+        kernel->gradient(x, y, partials);//partials[0] = df/dx, partials[1] = df/dy, partials[2] = f(x,y)
+Older C libraries need -ldl to link dlopen*/
+
+#ifndef NATIVE_KERNEL_HPP
+#define NATIVE_KERNEL_HPP
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cinttypes>
+#include <cerrno>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include "ExpressionTree.hpp"
+#include "ResultCache.hpp"
+
+/*****************************Structure Definitions**************************/
+enum nativeState {
+    NATIVE_BUILDING,//Queued or being compiled, use the interpreter for now
+    NATIVE_READY,//value and gradient can be called
+    NATIVE_FAILED//Could not be compiled or loaded, use the interpreter
+};
+
+typedef double (*nativeValueFunction)(double, double);
+typedef void (*nativeGradientFunction)(double, double, double *);
+
+//Compiled kernel of one function
+struct nativeKernel {
+    std::string function;//Function string without whitespace
+    uint64_t hash;
+    std::atomic<int> state;//nativeState, set to NATIVE_READY only after value and gradient are set
+    void *handle;//dlopen handle of the shared object
+    nativeValueFunction value;//f(x,y)
+    nativeGradientFunction gradient;//df/dx, df/dy and f(x,y)
+    nativeKernel() : hash(0), state(NATIVE_BUILDING), handle(NULL), value(NULL), gradient(NULL) {}
+};
+
+//Every kernel of the process and the thread that builds them
+struct nativeRegistry {
+    std::mutex lock;
+    std::condition_variable work;//Wakes the builder when a kernel is queued or the registry closes
+    std::condition_variable built;//Wakes threads in nativeWait when a kernel is done
+    std::unordered_map<uint64_t, std::unique_ptr<nativeKernel>> kernels;
+    std::deque<nativeKernel *> queue;//Kernels waiting for the builder
+    std::string dir;//Kernel directory, empty while native kernels are off
+    std::string compiler;
+    std::thread builder;
+    bool stop;
+    nativeRegistry() : stop(false) {}
+    ~nativeRegistry()//Kernels still queued are not built, the one being compiled is finished
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        work.notify_all();
+        if(builder.joinable())
+            builder.join();
+    }
+};
+
+/**********************Function Declarations**********************************/
+nativeRegistry &nativeRegistryOf();//Function to obtain the kernels of the process
+bool nativeEnable(const char *);//Function to turn native kernels on
+std::string nativeNumber(double);//Function to write a constant as a C++ literal
+std::string nativeSource(const exprTree &, const std::string &);//Function to translate a function to C++
+std::string nativePath(const nativeRegistry &, uint64_t, const char *);//Function to find a file of a kernel
+std::string nativeQuote(const std::string &);//Function to quote a path for the shell
+bool nativeLoad(nativeKernel &, const std::string &);//Function to load a compiled kernel
+bool nativeBuild(nativeRegistry &, nativeKernel &);//Function to compile and load a kernel
+void nativeBuilder(nativeRegistry *);//Function run by the builder thread
+nativeKernel *nativeLookup(const std::string &);//Function to obtain the kernel of a function
+bool nativeWait(nativeKernel *);//Function to wait until a kernel is built
+
+//Function to obtain the kernels of the process
+inline nativeRegistry &nativeRegistryOf()
+{
+    static nativeRegistry registry;
+    return registry;
+}
+
+//Function to turn native kernels on, with their files in dir(created if needed). Returns false if dir cannot be used
+inline bool nativeEnable(const char *dir)
+{
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: cannot create %s\n", dir);
+        return false;
+    }
+    nativeRegistry &registry = nativeRegistryOf();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    if(!registry.dir.empty())//Already on
+        return true;
+    registry.dir = dir;
+    const char *compiler = getenv("CXX");
+    registry.compiler = (compiler != NULL && compiler[0] != '\0') ? compiler : "c++";
+    registry.builder = std::thread(nativeBuilder, &registry);
+    return true;
+}
+
+//Function to write a constant as a C++ literal that reads back as the same double
+inline std::string nativeNumber(double value)
+{
+    if(std::isinf(value))
+        return value > 0 ? "HUGE_VAL" : "(-HUGE_VAL)";
+    if(std::isnan(value))
+        return "NAN";
+    char text[40];
+    snprintf(text, sizeof(text), value < 0 ? "(%.17g)" : "%.17g", value);
+    return text;
+}
+
+/*Function to translate the tree of a function to C++: greens_value(x,y) computes f and greens_gradient(x,y,result) computes
+f, df/dx and df/dy with the formulas of evalDual, one statement per node in the postorder of the tree. Node i gives fi,
+xi(df/dx) and yi(df/dy). The function string is kept in greens_function*/
+inline std::string nativeSource(const exprTree &tree, const std::string &function)
+{
+    static const char *unaryFunctions[] = {"sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh",
+                                           "exp", "log", "log10", "log2", "sqrt", "fabs", ""};
+    std::string values, gradient, escaped;
+    size_t i;
+    for(i = 0; i < function.size(); i++)
+    {
+        if(function[i] == '"' || function[i] == '\\')
+            escaped += '\\';
+        escaped += function[i];
+    }
+    for(i = 0; i < tree.nodes.size(); i++)
+    {
+        const exprNode &node = tree.nodes[i];
+        std::string n = std::to_string(i);
+        std::string f = "f" + n, dx = "x" + n, dy = "y" + n;
+        std::string p = node.left >= 0 ? std::to_string(node.left) : n, q = node.right >= 0 ? std::to_string(node.right) : n;
+        std::string fp = "f" + p, fq = "f" + q, xp = "x" + p, xq = "x" + q, yp = "y" + p, yq = "y" + q;
+        std::string value;//Expression for fi
+        std::string ddx, ddy;//Expressions for xi and yi
+        std::string d;//Derivative of the outer function for single argument functions(chain rule)
+        switch(node.type)
+        {
+            case NODE_CONSTANT: value = nativeNumber(node.value); ddx = ddy = "0.0"; break;
+            case NODE_X: value = "x"; ddx = "1.0"; ddy = "0.0"; break;
+            case NODE_Y: value = "y"; ddx = "0.0"; ddy = "1.0"; break;
+            case NODE_ADD: value = fp + " + " + fq; ddx = xp + " + " + xq; ddy = yp + " + " + yq; break;
+            case NODE_SUB: value = fp + " - " + fq; ddx = xp + " - " + xq; ddy = yp + " - " + yq; break;
+            case NODE_NEG: value = "-" + fp; ddx = "-" + xp; ddy = "-" + yp; break;
+            case NODE_MUL:
+                value = fp + " * " + fq;
+                ddx = xp + " * " + fq + " + " + fp + " * " + xq;
+                ddy = yp + " * " + fq + " + " + fp + " * " + yq;
+                break;
+            case NODE_DIV:
+                value = fp + " / " + fq;
+                ddx = "(" + xp + " - " + f + " * " + xq + ") / " + fq;
+                ddy = "(" + yp + " - " + f + " * " + yq + ") / " + fq;
+                break;
+            case NODE_MOD:
+                value = "fmod(" + fp + ", " + fq + ")";
+                ddx = xp + " - trunc(" + fp + " / " + fq + ") * " + xq;
+                ddy = yp + " - trunc(" + fp + " / " + fq + ") * " + yq;
+                break;
+            case NODE_POW://Constant exponent also valid for negative bases, (a^b)' = a^b * (b' ln(a) + b a'/a) otherwise
+                value = "pow(" + fp + ", " + fq + ")";
+                d = "(" + fq + " == 0.0 ? 0.0 : " + fq + " * pow(" + fp + ", " + fq + " - 1.0))";
+                ddx = "(" + xq + " == 0.0 && " + yq + " == 0.0) ? " + d + " * " + xp + " : " + f + " * (" + xq + " * log(" + fp + ") + " + fq + " * " + xp + " / " + fp + ")";
+                ddy = "(" + xq + " == 0.0 && " + yq + " == 0.0) ? " + d + " * " + yp + " : " + f + " * (" + yq + " * log(" + fp + ") + " + fq + " * " + yp + " / " + fp + ")";
+                break;
+            case NODE_ATAN2:
+                value = "atan2(" + fp + ", " + fq + ")";
+                ddx = "(" + fq + " * " + xp + " - " + fp + " * " + xq + ") / (" + fp + " * " + fp + " + " + fq + " * " + fq + ")";
+                ddy = "(" + fq + " * " + yp + " - " + fp + " * " + yq + ") / (" + fp + " * " + fp + " + " + fq + " * " + fq + ")";
+                break;
+            case NODE_HYPOT:
+                value = "hypot(" + fp + ", " + fq + ")";
+                ddx = "(" + fp + " * " + xp + " + " + fq + " * " + xq + ") / " + f;
+                ddy = "(" + fp + " * " + yp + " + " + fq + " * " + yq + ") / " + f;
+                break;
+            case NODE_MIN: case NODE_MAX:
+            {
+                std::string first = "(" + fp + (node.type == NODE_MIN ? " <= " : " >= ") + fq + ")";
+                value = first + " ? " + fp + " : " + fq;
+                ddx = first + " ? " + xp + " : " + xq;
+                ddy = first + " ? " + yp + " : " + yq;
+                break;
+            }
+            default:
+                if(node.type == NODE_SGN)
+                    value = "(" + fp + " > 0.0) ? 1.0 : ((" + fp + " < 0.0) ? -1.0 : 0.0)";
+                else
+                    value = std::string(unaryFunctions[node.type - NODE_SIN]) + "(" + fp + ")";
+                switch(node.type)
+                {
+                    case NODE_SIN: d = "cos(" + fp + ")"; break;
+                    case NODE_COS: d = "-sin(" + fp + ")"; break;
+                    case NODE_TAN: d = "(1.0 + " + f + " * " + f + ")"; break;
+                    case NODE_ASIN: d = "(1.0 / sqrt(1.0 - " + fp + " * " + fp + "))"; break;
+                    case NODE_ACOS: d = "(-1.0 / sqrt(1.0 - " + fp + " * " + fp + "))"; break;
+                    case NODE_ATAN: d = "(1.0 / (1.0 + " + fp + " * " + fp + "))"; break;
+                    case NODE_SINH: d = "cosh(" + fp + ")"; break;
+                    case NODE_COSH: d = "sinh(" + fp + ")"; break;
+                    case NODE_TANH: d = "(1.0 - " + f + " * " + f + ")"; break;
+                    case NODE_EXP: d = f; break;
+                    case NODE_LOG: d = "(1.0 / " + fp + ")"; break;
+                    case NODE_LOG10: d = "(1.0 / (" + fp + " * M_LN10))"; break;
+                    case NODE_LOG2: d = "(1.0 / (" + fp + " * M_LN2))"; break;
+                    case NODE_SQRT: d = "(0.5 / " + f + ")"; break;
+                    case NODE_ABS: d = "((" + fp + " < 0.0) ? -1.0 : 1.0)"; break;
+                    default: d = "0.0"; break;//sgn
+                }
+                ddx = d + " * " + xp;
+                ddy = d + " * " + yp;
+                break;
+        }
+        values += "    const double " + f + " = " + value + ";\n";
+        gradient += "    const double " + f + " = " + value + ";\n";
+        gradient += "    const double " + dx + " = " + ddx + ";\n";
+        gradient += "    const double " + dy + " = " + ddy + ";\n";
+    }
+    std::string root = std::to_string(tree.nodes.size() - 1);
+    std::string source = "//f(x,y) = " + function + ", generated by NativeKernel.hpp\n";
+    source += "#include <cmath>\n";
+    source += "using namespace std;\n\n";
+    source += "extern \"C\" const char greens_function[] = \"" + escaped + "\";\n\n";
+    source += "extern \"C\" double greens_value(double x, double y)\n{\n" + values + "    return f" + root + ";\n}\n\n";
+    source += "extern \"C\" void greens_gradient(double x, double y, double result[3])\n{\n" + gradient;
+    source += "    result[0] = x" + root + ";\n    result[1] = y" + root + ";\n    result[2] = f" + root + ";\n}\n";
+    return source;
+}
+
+//Function to find a file of a kernel in the kernel directory: greens_<hash><extension>
+inline std::string nativePath(const nativeRegistry &registry, uint64_t hash, const char *extension)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "greens_%016" PRIx64 "%s", hash, extension);
+    return registry.dir + "/" + name;
+}
+
+//Function to quote a path for the shell
+inline std::string nativeQuote(const std::string &text)
+{
+    std::string quoted = "'";
+    size_t i;
+    for(i = 0; i < text.size(); i++)
+    {
+        if(text[i] == '\'')
+            quoted += "'\\''";
+        else
+            quoted += text[i];
+    }
+    return quoted + "'";
+}
+
+/*Function to load the shared object at path into kernel. Returns false if it cannot be loaded or was built for another
+function with the same hash*/
+inline bool nativeLoad(nativeKernel &kernel, const std::string &path)
+{
+    void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(handle == NULL)
+        return false;
+    const char *function = (const char *)dlsym(handle, "greens_function");
+    nativeValueFunction value = (nativeValueFunction)dlsym(handle, "greens_value");
+    nativeGradientFunction gradient = (nativeGradientFunction)dlsym(handle, "greens_gradient");
+    if(function == NULL || value == NULL || gradient == NULL || kernel.function != function)
+    {
+        dlclose(handle);
+        return false;
+    }
+    kernel.handle = handle;
+    kernel.value = value;
+    kernel.gradient = gradient;
+    kernel.state.store(NATIVE_READY, std::memory_order_release);
+    return true;
+}
+
+/*Function to translate, compile and load a kernel. Source and shared object are written under temporary names and
+renamed, so another process sharing the kernel directory never loads half a file. Compiler messages go to
+greens_<hash>.log*/
+inline bool nativeBuild(nativeRegistry &registry, nativeKernel &kernel)
+{
+    exprTree tree;
+    if(!parseTree(kernel.function, tree))
+        return false;
+    std::string suffix = "." + std::to_string((long)getpid());
+    std::string source = nativePath(registry, kernel.hash, ".cpp"), object = nativePath(registry, kernel.hash, ".so");
+    FILE *file = fopen((source + suffix).c_str(), "w");
+    if(file == NULL)
+        return false;
+    std::string text = nativeSource(tree, kernel.function);
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename((source + suffix).c_str(), source.c_str()) != 0)
+    {
+        unlink((source + suffix).c_str());
+        return false;
+    }
+    //-ffp-contract=off keeps the kernel rounding like evalDual, no fused multiply-adds
+    std::string command = registry.compiler + " -O2 -ffp-contract=off -shared -fPIC -x c++ -o " + nativeQuote(object + suffix) +
+                          " " + nativeQuote(source) + " > " + nativeQuote(nativePath(registry, kernel.hash, ".log")) + " 2>&1";
+    if(system(command.c_str()) != 0 || rename((object + suffix).c_str(), object.c_str()) != 0)
+    {
+        unlink((object + suffix).c_str());
+        fprintf(stderr, "Warning: native kernel of %s did not compile, see %s\n", kernel.function.c_str(), nativePath(registry, kernel.hash, ".log").c_str());
+        return false;
+    }
+    return nativeLoad(kernel, object);
+}
+
+//Function run by the builder thread: builds the queued kernels one after another
+inline void nativeBuilder(nativeRegistry *registry)
+{
+    std::unique_lock<std::mutex> guard(registry->lock);
+    while(true)
+    {
+        registry->work.wait(guard, [registry]() { return registry->stop || !registry->queue.empty(); });
+        if(registry->stop)
+            return;
+        nativeKernel *kernel = registry->queue.front();
+        registry->queue.pop_front();
+        guard.unlock();
+        if(!nativeBuild(*registry, *kernel))
+            kernel->state.store(NATIVE_FAILED, std::memory_order_release);
+        guard.lock();
+        registry->built.notify_all();
+    }
+}
+
+/*Function to obtain the kernel of a function. A kernel already in the process or on disk is returned ready, otherwise it is
+queued for the builder and returned in NATIVE_BUILDING. Returns NULL if native kernels are off, if the function uses
+something the expression tree cannot parse, or if another function with the same hash has a kernel in this process*/
+inline nativeKernel *nativeLookup(const std::string &function)
+{
+    nativeRegistry &registry = nativeRegistryOf();
+    std::string canonical = memoFunction(function);
+    uint64_t hash = memoHash(canonical);
+    std::unique_lock<std::mutex> guard(registry.lock);
+    if(registry.dir.empty())
+        return NULL;
+    std::unordered_map<uint64_t, std::unique_ptr<nativeKernel>>::iterator it = registry.kernels.find(hash);
+    if(it != registry.kernels.end())
+        return it->second->function == canonical ? it->second.get() : NULL;
+    exprTree tree;
+    if(!parseTree(canonical, tree))
+        return NULL;
+    nativeKernel *kernel = new nativeKernel();
+    registry.kernels[hash].reset(kernel);
+    kernel->function = canonical;
+    kernel->hash = hash;
+    if(access(nativePath(registry, hash, ".so").c_str(), R_OK) == 0 && nativeLoad(*kernel, nativePath(registry, hash, ".so")))
+        return kernel;//Built by an earlier run
+    registry.queue.push_back(kernel);
+    registry.work.notify_one();
+    return kernel;
+}
+
+//Function to wait until a kernel is built, returns true if it is ready
+inline bool nativeWait(nativeKernel *kernel)
+{
+    nativeRegistry &registry = nativeRegistryOf();
+    std::unique_lock<std::mutex> guard(registry.lock);
+    registry.built.wait(guard, [kernel]() { return kernel->state.load() != NATIVE_BUILDING; });
+    return kernel->state.load() == NATIVE_READY;
+}
+
+#endif
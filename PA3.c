@@ -3,52 +3,69 @@
 //PA3 v1.0
 /*This program calculates the area of any polygon in the plane (R^2) given
 its verticies using Green's Theorem. The greens function actually does the
-computation*/
+computation. Verticies are entered one coordinate at a time, or read from a file:
+PA3 file.txt reads a text file of x,y coordinates, PA3 -b file.bin a file of raw
+little-endian float64 x,y pairs and PA3 - text coordinates from stdin.
+Build: gcc -O2 -pthread PA3.c -o PA3 -lm(threads for the parallel file reader of PointFile.h, libm for fma)*/
 
 #include <stdio.h>
+#include <string.h>
+#include "PolygonArea.h"
+#include "PointFile.h"
 
 double greens(double[]);//Function declaration, coordinates can be decimals
-int numVerticies;//Number of verticies polygin has
+size_t numVerticies;//Number of verticies polygin has
 double area;//Area of polygon
 
-int main()
+int main(int argc, char *argv[])
 {
-  printf("Enter the number of verticies the polygon has\n");
-  scanf("%d", &numVerticies);
-  /*Each element in coordinate (x or y) gets 1 cell in array, so array needs
-  to be of size numVerticies * 2 */
-  double verticies[numVerticies * 2];
-  int idx = 0;
-  while(idx < (numVerticies * 2))//Getting inputs
+  pointBuffer verticies;//Each element in coordinate (x or y) gets 1 cell in array, numVerticies * 2 cells
+  if(argc > 1)//Reading verticies from a file
   {
-    if(idx % 2 == 0)
-      printf("Enter x-coordinate of vertex %d \n", (idx / 2) + 1);
+    int ok;
+    if(strcmp(argv[1], "-b") == 0 && argc > 2)
+      ok = readPointsBinary(argv[2], &verticies);
+    else if(strcmp(argv[1], "-") == 0)
+      ok = readPointsStream(stdin, &verticies);
     else
-      printf("Enter y-coordinate of vertex %d \n", (idx  / 2) + 1);
-    scanf("%lf", &verticies[idx]);
-    idx++;
+      ok = readPointsText(argv[1], &verticies, 0);
+    if(!ok)
+      return 1;
   }
-  area = greens(verticies);//Calculating area
-  printf("The area of the polygon with %d verticies is %lf \n", numVerticies, area);
+  else
+  {
+    printf("Enter the number of verticies the polygon has\n");
+    if(scanf("%zu", &numVerticies) != 1)
+      return 1;
+    memset(&verticies, 0, sizeof(verticies));
+    verticies.xy = (double *)malloc((numVerticies ? numVerticies : 1) * 2 * sizeof(double));//On the heap, large polygons would overflow the stack
+    if(verticies.xy == NULL)
+    {
+      printf("Error: not enough memory for %zu verticies\n", numVerticies);
+      return 1;
+    }
+    verticies.n = numVerticies;
+    size_t idx = 0;
+    while(idx < (numVerticies * 2))//Getting inputs
+    {
+      if(idx % 2 == 0)
+        printf("Enter x-coordinate of vertex %zu \n", (idx / 2) + 1);
+      else
+        printf("Enter y-coordinate of vertex %zu \n", (idx  / 2) + 1);
+      if(scanf("%lf", &verticies.xy[idx]) != 1)
+        return 1;
+      idx++;
+    }
+  }
+  numVerticies = verticies.n;
+  area = greens(verticies.xy);//Calculating area
+  printf("The area of the polygon with %zu verticies is %lf \n", numVerticies, area);
+  freePoints(&verticies);
   return 0;
 }
 
-//Function that does actual computation using Green's Theorem
+//Function that does actual computation using Green's Theorem, v holds the vertices as x,y pairs
 double greens(double v[])
 {
-  double area = 0.0;
-  int idx = 0;//Index in array
-  int numItr = 0;//Number of iterations(additions). Actual formula is defined using series
-  while(numItr < numVerticies)
-  {
-    if(numItr < numVerticies - 1)
-      area += ((v[idx] * v[idx + 3]) - (v[idx + 2] * v[idx + 1]));
-    else
-      area += ((v[idx] * v[1]) - (v[0] * v[idx + 1]));
-    idx += 2;
-    numItr = numItr + 1;
-  }
-  if(area < 0)//Area cannot be negative
-    area *= -1;
-  return (area / 2);
+  return polygonArea(v, v + 1, numVerticies, 2);
 }
@@ -11,6 +11,16 @@ Mathematics Division*/
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <mutex>
+#include "PolygonArea.h"
+#include "ConvexHull.hpp"
+#include "PointFile.h"
+#include "Manifest.hpp"
+#include "Daemon.hpp"
+#include "Instrument.hpp"
 using namespace std;
 
 /************************Structure Declarations***********************************************************/
@@ -21,12 +31,23 @@ struct point{
 };
 
 point lowerLeft;//Lower left point of shape
+/*Points given for a convex shape usually include points inside it, which would make the polygon from modifiedGraham cut
+into the shape. With USE_HULL only the vertices of the convex hull are given to chenLai, modifiedGraham orders every point*/
+bool USE_HULL = true;
+hullMethod HULL_METHOD = HULL_AUTO;//Monotone chain, Quickhull for very large sets
+unsigned NUM_THREADS = 0;//Number of threads used to order large point sets, 0 uses every core
+const size_t PARALLEL_GRAIN = 1 << 16;//Point sets smaller than this are ordered on one thread
 string pointToString(point);//Function to create a string representation of a point
-bool compare(point, point);//Compares two points
+bool compare(const point &, const point &);//Compares two points
+bool samePoint(const point &, const point &);//Determines if two points are identical
+bool isLowerLeft(const point &);//Determines if a point is identical to lowerLeft
 double distsqLL(point);//Calculates the square distance between a point and the lower left point
-vector<point> modifiedGraham(vector<point>);//Function to create a polygon given a set of points
-int findLL(vector<point>);//Function to find the position of the leftmost lowest point in the set
-double chenLai(vector<point>);//Function to calculate area given an ordered list of points
+void modifiedGraham(vector<point> &);//Function to create a polygon given a set of points
+bool lowerThan(const point &, const point &);//Determines if a point is lower(then further left) than another
+size_t findLL(const vector<point> &);//Function to find the position of the leftmost lowest point in the set
+void parallelSort(point *, point *);//Function to sort points by angle on several threads
+double chenLai(const vector<point> &);//Function to calculate area given an ordered list of points
+shapeResult computeShape(const manifestShape &);//Function to calculate the area of one shape of a batch manifest
 
 //Function to create a string representation of a point
 string pointToString(point point1)
@@ -34,32 +55,29 @@ string pointToString(point point1)
   return "(" + to_string(point1.x) + "," + to_string(point1.y)+ "); ";
 }
 
-/*Function to compare to points. Returns 1 if p is greater than q, returns -1 if p is less than q. A point is greater than
- * another point if it has a greater theta(angular distance from lowerRight). If two points have the same theta, the point that is
- * closer to lowerRight(distance formula) is greater. Two points are considered equal if and only if their theta values are equal
- * and they are the same distance from lowerRight. In this case the function returns 0*/
-bool compare(point p, point q)
+/*Function to compare two points. Returns true if p comes before q, i.e. p has the smaller angle theta(angular distance
+ * from lowerLeft). Since lowerLeft is the lowest point every other point has 0 <= theta < pi, so p comes before q exactly when
+ * q is counterclockwise of p, which is the sign of the cross product (p - lowerLeft) x (q - lowerLeft) and needs no trig.
+ * The cross product is calculated with crossDiff(FMA corrected) so points that are nearly collinear with lowerLeft are
+ * still ordered correctly. If two points have the same theta, the point that is closer to lowerLeft comes first*/
+bool compare(const point &p, const point &q)
 {
-    double thetaLLP = atan2(p.y - lowerLeft.y, p.x - lowerLeft.x);//Angle between p and lowerLeft
-    double thetaLLQ = atan2(q.y - lowerLeft.y, q.x - lowerLeft.x);//Angle between q and lowerLeft
-    if(thetaLLP > thetaLLQ)//If angle between lowerLeft and p is greater
-        return false;
-    else if(thetaLLP < thetaLLQ)//if angle between lowerLeft and q is greater
-        return true;
-    else//Angle between lowerLeft and p = angle between lowerLeft and q
-    {
-        double distLLP = distsqLL(p);
-        double distLLQ = distsqLL(q);
-        if(distLLP < distLLQ)//Distance between lowerLeft and q is greater
-            return false;
-        else if(distLLP > distLLQ)//Distance between lowerLeft and p is greater
-            return true;
-        else//Two identical points in same set
-        {
-            cout << "Error, two identical points in the same set!";
-            abort();
-        }
-    }
+    double orientation = crossDiff(p.x - lowerLeft.x, q.y - lowerLeft.y, p.y - lowerLeft.y, q.x - lowerLeft.x);
+    if(orientation != 0.0)
+        return orientation > 0.0;
+    return distsqLL(p) < distsqLL(q);//Same angle
+}
+
+//Function to determine if two points are identical
+bool samePoint(const point &p, const point &q)
+{
+    return p.x == q.x && p.y == q.y;
+}
+
+//Function to determine if a point is identical to lowerLeft
+bool isLowerLeft(const point &p)
+{
+    return samePoint(p, lowerLeft);
 }
 
 //Function to calculate the square distance between a point and lowerLeft
@@ -69,84 +87,216 @@ double distsqLL(point p)
 }
 
 /*Function to order the points on the boundary of the shape in the correct order using a modified version of
-Graham's Method*/
-vector<point> modifiedGraham(vector<point> points)
+Graham's Method. The points are ordered in place: lowerLeft is swapped to the front and the rest are sorted behind it.
+Duplicate points are dropped*/
+void modifiedGraham(vector<point> &points)
 {
-    int lP = findLL(points);//Finding lowerLeftPos
-    lowerLeft = points[lP];
-    points.erase(points.begin() + lP);//Remove lowerLeft from set
-    sort(points.begin(), points.end(), compare);//Sort points
-    vector<point> boundaryPoints;//New vector containing all the points in order
-    boundaryPoints.push_back(lowerLeft);//LowerLeft goes first
-    int i;
-    for(i = 0; i < points.size(); i++)//Adding other points in order
-        boundaryPoints.push_back(points[i]);
-    return boundaryPoints;
+    if(points.empty())
+        return;
+    size_t lP = findLL(points);//Finding lowerLeftPos
+    swap(points[0], points[lP]);//LowerLeft goes first
+    lowerLeft = points[0];
+    points.erase(remove_if(points.begin() + 1, points.end(), isLowerLeft), points.end());//Remove any copies of lowerLeft
+    parallelSort(&points[0] + 1, &points[0] + points.size());//Sort points
+    points.erase(unique(points.begin() + 1, points.end(), samePoint), points.end());//Other duplicate points are adjacent after sorting
+    size_t last = points.size() - 1;//Points on the last ray are walked back towards lowerLeft, so they go furthest first
+    while(last > 1 && crossDiff(points[last - 1].x - lowerLeft.x, points.back().y - lowerLeft.y, points[last - 1].y - lowerLeft.y, points.back().x - lowerLeft.x) == 0.0)
+        last--;
+    if(last > 1)
+        reverse(points.begin() + last, points.end());
 }
 
-//Function to find the position of the lower leftmost point of the point set
-int findLL(vector<point> points)
+//Function to determine if p is lower than q, or at the same height and further left
+bool lowerThan(const point &p, const point &q)
 {
-    int lowerLeftPos = 0;
-    int size = points.size();
-    int i;
-    for(i = 1; i < size; i++) {//LinearSearch
-        if (points[i].y < points[lowerLeftPos].y || (points[i].y == points[lowerLeftPos].y && points[i].x < points[lowerLeftPos].x))
-            lowerLeftPos = i;
-    }
-    return lowerLeftPos;
+    return p.y < q.y || (p.y == q.y && p.x < q.x);
 }
 
-/*Function that actually calculates area, given points along boundary of shape
-using variation of Green's Theorem*/
-double chenLai(vector<point> orderedPoints)
+/*Function to find the position of the lower leftmost point of the point set. Large sets are split into one chunk per
+thread, each finds the lowest point of its chunk and the chunk minima are reduced in order*/
+size_t findLL(const vector<point> &points)
 {
-    double area = 0.0;
-    int idx = 0;//Index in vector
-    int numItr = 0;//Number of iterations(additions). Actual formula is defined using series
-    int size = orderedPoints.size();
-    while(numItr < size)
+    size_t size = points.size();
+    unsigned numThreads = NUM_THREADS ? NUM_THREADS : max(1u, thread::hardware_concurrency());
+    size_t chunks = (size >= 2 * PARALLEL_GRAIN) ? min((size_t)numThreads, size / PARALLEL_GRAIN) : 1;
+    vector<size_t> chunkLL(chunks);
+    auto search = [&](size_t c)
     {
-        if(numItr < size - 1)
-        {
-            area += ((orderedPoints[idx].x * orderedPoints[idx + 1].y) - (orderedPoints[idx].y * orderedPoints[idx + 1].x));
-        }
-        else
+        size_t i, lowerLeftPos = size * c / chunks, end = size * (c + 1) / chunks;
+        for(i = lowerLeftPos + 1; i < end; i++)//LinearSearch
         {
-            area += ((orderedPoints[idx].x * orderedPoints[0].y) - (orderedPoints[0].x * orderedPoints[idx].y));
+            if(lowerThan(points[i], points[lowerLeftPos]))
+                lowerLeftPos = i;
         }
-        idx++;
-        numItr++;
+        chunkLL[c] = lowerLeftPos;
+    };
+    vector<thread> workers;
+    size_t c;
+    for(c = 1; c < chunks; c++)
+        workers.push_back(thread(search, c));
+    search(0);
+    for(c = 0; c < workers.size(); c++)
+        workers[c].join();
+    size_t lowerLeftPos = chunkLL[0];
+    for(c = 1; c < chunks; c++)
+    {
+        if(lowerThan(points[chunkLL[c]], points[lowerLeftPos]))
+            lowerLeftPos = chunkLL[c];
+    }
+    return lowerLeftPos;
+}
+
+/*Function to sort the points in [first, last) with compare on several threads. Each thread sorts one chunk, then
+neighbouring chunks are merged in place pairwise, doubling the chunk size each round until one sorted run is left*/
+void parallelSort(point *first, point *last)
+{
+    size_t size = last - first;
+    unsigned numThreads = NUM_THREADS ? NUM_THREADS : max(1u, thread::hardware_concurrency());
+    size_t chunks = (size >= 2 * PARALLEL_GRAIN) ? min((size_t)numThreads, size / PARALLEL_GRAIN) : 1;
+    if(chunks == 1)
+    {
+        sort(first, last, compare);
+        return;
     }
-    if(area < 0)//Area cannot be negative
+    vector<size_t> bounds(chunks + 1);//Chunk c is [bounds[c], bounds[c + 1])
+    size_t c;
+    for(c = 0; c <= chunks; c++)
+        bounds[c] = size * c / chunks;
+    vector<thread> workers;
+    for(c = 0; c < chunks; c++)
+        workers.push_back(thread([=]() { sort(first + bounds[c], first + bounds[c + 1], compare); }));
+    for(c = 0; c < workers.size(); c++)
+        workers[c].join();
+    size_t width;
+    for(width = 1; width < chunks; width *= 2)//Merge rounds
     {
-        area *= -1;
+        workers.clear();
+        for(c = 0; c + width < chunks; c += 2 * width)
+        {
+            point *begin = first + bounds[c], *middle = first + bounds[c + width], *end = first + bounds[min(c + 2 * width, chunks)];
+            workers.push_back(thread([=]() { inplace_merge(begin, middle, end, compare); }));
+        }
+        for(c = 0; c < workers.size(); c++)
+            workers[c].join();
     }
-    return (area / 2);
 }
 
-int main()
+/*Function that actually calculates area, given points along boundary of shape
+using variation of Green's Theorem*/
+double chenLai(const vector<point> &orderedPoints)
 {
+    INSTRUMENT_STAGE(AREA);
+    if(orderedPoints.empty())
+        return 0.0;
+    return polygonArea(&orderedPoints[0].x, &orderedPoints[0].y, orderedPoints.size(), 2);
+}
+
+/*Function to calculate the area of one shape of a batch manifest. The points of the shape are given by
+"point x y" lines, "file path" lines(text file) and "binary path" lines(raw float64 x,y file)*/
+shapeResult computeShape(const manifestShape &shape)
+{
+    shapeResult result;
+    result.ok = false;
+    result.area = 0.0;
+    result.points = 0;
     vector<point> boundaryPoints;
-    while(1)
+    size_t i;
+    for(i = 0; i < shape.lines.size(); i++)
     {
-        string input;
-        cout << "Enter point on boundary of shape in this format: (x,y), and enter end when done.\n";
-        cin >> input;
-        if(input.compare("end") != 0)
+        const manifestLine &line = shape.lines[i];
+        string rest;
+        double v[2];
+        if(line.keyword == "point" && takeNumbers(line.rest, 2, v, rest) && rest.empty())
         {
             point point1;
-            int commaPos = input.find(',');
-            point1.x = stod(input.substr(1, commaPos));
-            point1.y = stod(input.substr(commaPos + 1, input.length() - 1));
+            point1.x = v[0];
+            point1.y = v[1];
             boundaryPoints.push_back(point1);
         }
+        else if(line.keyword == "file" || line.keyword == "binary")
+        {
+            INSTRUMENT_STAGE(PARSE);
+            pointBuffer input;
+            int ok = line.keyword == "file" ? readPointsText(line.rest.c_str(), &input, 1) : readPointsBinary(line.rest.c_str(), &input);
+            if(!ok)
+            {
+                result.error = "line " + to_string(line.line) + ": cannot read points from " + line.rest;
+                return result;
+            }
+            const point *first = (const point *)input.xy;
+            boundaryPoints.insert(boundaryPoints.end(), first, first + input.n);
+            freePoints(&input);
+        }
         else
         {
-            break;
+            result.error = "line " + to_string(line.line) + ": expected point x y, file path or binary path";
+            return result;
         }
     }
-    vector<point> points = modifiedGraham(boundaryPoints);
+    if(USE_HULL)
+    {
+        INSTRUMENT_STAGE(ORDER);
+        boundaryPoints = convexHull(boundaryPoints, HULL_METHOD, 1);//Shapes are already spread over the batch workers
+    }
+    else
+    {
+        INSTRUMENT_STAGE(ORDER);
+        static mutex grahamLock;//modifiedGraham orders around the shared lowerLeft, one shape at a time
+        lock_guard<mutex> lock(grahamLock);
+        modifiedGraham(boundaryPoints);
+    }
+    result.ok = true;
+    result.area = chenLai(boundaryPoints);
+    result.points = boundaryPoints.size();
+    return result;
+}
+
+/*Points are read from stdin in this format: (x,y), or from a file: Pleiades file.txt reads a text file of x,y coordinates
+(CSV, whitespace separated or (x,y)) and Pleiades -b file.bin a file of raw little-endian float64 x,y pairs.
+Pleiades --batch manifest.txt [results.csv] computes every shape of a manifest(see Manifest.hpp)
+and Pleiades --daemon [socket path] serves shape requests from stdin or a Unix socket(see Daemon.hpp).
+Any of these can be preceded by --profile report.csv(or .json) to write the counters and stage times of every shape,
+in a build with -DGREENS_INSTRUMENT(see Instrument.hpp)*/
+int main(int argc, char *argv[])
+{
+    if(argc > 2 && string(argv[1]) == "--profile")
+    {
+        instrumentProfile(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    if(argc > 2 && string(argv[1]) == "--batch")
+        return runBatch(argv[2], argc > 3 ? argv[3] : NULL, NUM_THREADS, computeShape);
+    if(argc > 1 && string(argv[1]) == "--daemon")
+        return runDaemon(argc > 2 ? argv[2] : NULL, NUM_THREADS, computeShape);
+    pointBuffer input;
+    int ok;
+    if(argc > 2 && string(argv[1]) == "-b")
+        ok = readPointsBinary(argv[2], &input);
+    else if(argc > 1 && string(argv[1]) != "-")
+        ok = readPointsText(argv[1], &input, NUM_THREADS);
+    else
+    {
+        cout << "Enter points on boundary of shape in this format: (x,y), and end the input(Ctrl-D) when done.\n";
+        ok = readPointsStream(stdin, &input);
+    }
+    if(!ok)
+        return 1;
+    INSTRUMENT_SHAPE("Pleiades");
+    const point *first = (const point *)input.xy;//Same layout as interleaved x,y
+    vector<point> boundaryPoints(first, first + input.n);
+    freePoints(&input);
+    vector<point> &points = boundaryPoints;
+    if(USE_HULL)
+    {
+        INSTRUMENT_STAGE(ORDER);
+        points = convexHull(boundaryPoints, HULL_METHOD);
+    }
+    else
+    {
+        INSTRUMENT_STAGE(ORDER);
+        modifiedGraham(points);//Ordered in place
+    }
     int i;
     for(i = 0; i < points.size(); i++)
     {
@@ -0,0 +1,359 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*PointFile - reading large sets of points for Pleiades and PA3. Written in C so PA3 can use it too. Points are returned
+as interleaved x,y doubles(x0 y0 x1 y1 ...), the layout PA3 uses and the same memory layout as an array of Pleiades points.
+Three inputs are supported:
+ - binary files of raw little-endian float64 x,y pairs, memory mapped so loading costs no copy at all
+ - text files(CSV, whitespace separated or Pleiades' "(x,y)" format), memory mapped and parsed in one chunk per thread
+ - text streamed from stdin(or any FILE), parsed block by block
+In text every character that cannot start a number separates numbers, so "1,2", "1 2" and "(1,2)" all read the same.
+Numbers are parsed with std::from_chars when compiled as C++17, strtod otherwise. Link with -pthread*/
+
+#ifndef POINT_FILE_H
+#define POINT_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__cplusplus) && __cplusplus >= 201703L
+#include <charconv>
+#define POINT_FILE_FROM_CHARS
+#endif
+
+/*****************************Structure Definitions**************************/
+//Points read from a file
+typedef struct {
+  double *xy;//Interleaved coordinates, point i is (xy[2 * i], xy[2 * i + 1])
+  size_t n;//Number of points
+  void *map;//Memory mapping xy points into, NULL if xy was allocated with malloc
+  size_t mapBytes;//Size of the mapping
+} pointBuffer;
+
+//Numbers parsed from one chunk of text
+typedef struct {
+  const char *begin, *end;//Text of the chunk
+  double *values;//Numbers read, allocated with malloc
+  size_t count, capacity;
+  int ok;//0 if a number was malformed or memory ran out
+} numberChunk;
+
+#define POINT_FILE_MAX_THREADS 64//Most threads used to parse one file
+#define POINT_FILE_MIN_CHUNK (1 << 20)//Text files are only split into chunks of at least this many bytes
+#define POINT_FILE_BLOCK (1 << 20)//Size of the blocks read from a stream
+
+/**********************Function Declarations**********************************/
+static inline int readPointsBinary(const char *, pointBuffer *);//Function to read a raw little-endian float64 x,y file
+static inline int readPointsText(const char *, pointBuffer *, unsigned);//Function to read a text file on several threads
+static inline int readPointsStream(FILE *, pointBuffer *);//Function to read text from a stream such as stdin
+static inline void freePoints(pointBuffer *);//Function to release the memory of a pointBuffer
+
+//Function to determine if a character can start a number
+static inline int startsNumber(char c)
+{
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+//Function to determine if a character can be part of a number
+static inline int inNumber(char c)
+{
+  return startsNumber(c) || c == 'e' || c == 'E';
+}
+
+/*Function to parse the number in [begin, end), which is exactly one token. Returns 0 if it is not a valid number*/
+static inline int parseNumber(const char *begin, const char *end, double *value)
+{
+  if(begin < end && *begin == '+')//from_chars does not take a leading +
+    begin++;
+#ifdef POINT_FILE_FROM_CHARS
+  std::from_chars_result result = std::from_chars(begin, end, *value);
+  return result.ec == std::errc() && result.ptr == end;
+#else
+  char token[64];//The mapped text is not null terminated, so strtod gets a copy
+  size_t length = end - begin;
+  char *stop;
+  if(length == 0 || length >= sizeof(token))
+    return 0;
+  memcpy(token, begin, length);
+  token[length] = '\0';
+  *value = strtod(token, &stop);
+  return stop == token + length;
+#endif
+}
+
+//Function to add a number to a chunk, growing its array as needed
+static inline int pushNumber(numberChunk *chunk, double value)
+{
+  if(chunk->count == chunk->capacity)
+  {
+    size_t capacity = chunk->capacity ? 2 * chunk->capacity : 1024;
+    double *values = (double *)realloc(chunk->values, capacity * sizeof(double));
+    if(values == NULL)
+      return 0;
+    chunk->values = values;
+    chunk->capacity = capacity;
+  }
+  chunk->values[chunk->count++] = value;
+  return 1;
+}
+
+/*Function to parse every number of a chunk of text. Returns a pointer to the unparsed tail of the text: for a complete
+chunk that is end, for a block of a stream it is the start of a number that may continue in the next block*/
+static inline const char *parseChunk(numberChunk *chunk, const char *begin, const char *end, int complete)
+{
+  const char *p = begin;
+  while(p < end)
+  {
+    if(!startsNumber(*p))//Separator
+    {
+      p++;
+      continue;
+    }
+    const char *token = p;
+    while(p < end && inNumber(*p))
+      p++;
+    if(p == end && !complete)//Number may be cut off by the end of the block
+      return token;
+    double value;
+    if(!parseNumber(token, p, &value) || !pushNumber(chunk, value))
+    {
+      chunk->ok = 0;
+      return end;
+    }
+  }
+  return end;
+}
+
+//Function run by each parsing thread
+static inline void *parseChunkThread(void *arg)
+{
+  numberChunk *chunk = (numberChunk *)arg;
+  parseChunk(chunk, chunk->begin, chunk->end, 1);
+  return NULL;
+}
+
+/*Function to move the numbers of the chunks, in order, into one array of points. Returns 0 if a chunk failed or the
+number of coordinates is odd*/
+static inline int collectChunks(numberChunk *chunks, unsigned numChunks, pointBuffer *points)
+{
+  size_t total = 0, at = 0;
+  unsigned c;
+  int ok = 1;
+  for(c = 0; c < numChunks; c++)
+  {
+    total += chunks[c].count;
+    ok = ok && chunks[c].ok;
+  }
+  if(!ok)
+    fprintf(stderr, "Error: malformed number in the input\n");
+  else if(total % 2 != 0)
+  {
+    fprintf(stderr, "Error: odd number of coordinates, the last point has no y-coordinate\n");
+    ok = 0;
+  }
+  if(ok && numChunks == 1)//One chunk already is the array
+  {
+    points->xy = chunks[0].values;
+    chunks[0].values = NULL;
+  }
+  else if(ok)
+  {
+    points->xy = (double *)malloc((total ? total : 1) * sizeof(double));
+    ok = points->xy != NULL;
+    for(c = 0; ok && c < numChunks; c++)
+    {
+      memcpy(points->xy + at, chunks[c].values, chunks[c].count * sizeof(double));
+      at += chunks[c].count;
+    }
+  }
+  for(c = 0; c < numChunks; c++)
+    free(chunks[c].values);
+  points->n = ok ? total / 2 : 0;
+  points->map = NULL;
+  points->mapBytes = 0;
+  return ok;
+}
+
+/*Function to read a binary file of raw little-endian float64 x,y pairs. On a little-endian machine the file is memory
+mapped and used in place, otherwise it is copied with the bytes swapped. Returns 0 on failure*/
+static inline int readPointsBinary(const char *path, pointBuffer *points)
+{
+  struct stat info;
+  int fd = open(path, O_RDONLY);
+  memset(points, 0, sizeof(*points));
+  if(fd < 0 || fstat(fd, &info) != 0)
+  {
+    fprintf(stderr, "Error: cannot open %s\n", path);
+    if(fd >= 0)
+      close(fd);
+    return 0;
+  }
+  size_t bytes = info.st_size;
+  if(bytes % (2 * sizeof(double)) != 0)
+  {
+    fprintf(stderr, "Error: %s is not a whole number of float64 x,y pairs\n", path);
+    close(fd);
+    return 0;
+  }
+  if(bytes == 0)
+  {
+    close(fd);
+    return 1;
+  }
+  void *map = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);//The mapping stays valid
+  if(map == MAP_FAILED)
+  {
+    fprintf(stderr, "Error: cannot map %s\n", path);
+    return 0;
+  }
+  points->n = bytes / (2 * sizeof(double));
+  const uint16_t one = 1;
+  if(*(const uint8_t *)&one == 1)//Little-endian, use the file as it is
+  {
+    madvise(map, bytes, MADV_SEQUENTIAL);
+    points->xy = (double *)map;
+    points->map = map;
+    points->mapBytes = bytes;
+    return 1;
+  }
+  points->xy = (double *)malloc(bytes);
+  if(points->xy == NULL)
+  {
+    munmap(map, bytes);
+    points->n = 0;
+    return 0;
+  }
+  size_t i;
+  for(i = 0; i < 2 * points->n; i++)//Big-endian, swap the bytes of every coordinate
+  {
+    uint64_t bits;
+    memcpy(&bits, (const char *)map + i * sizeof(double), sizeof(bits));
+    bits = ((bits & 0x00000000000000FFULL) << 56) | ((bits & 0x000000000000FF00ULL) << 40) |
+           ((bits & 0x0000000000FF0000ULL) << 24) | ((bits & 0x00000000FF000000ULL) << 8) |
+           ((bits & 0x000000FF00000000ULL) >> 8) | ((bits & 0x0000FF0000000000ULL) >> 24) |
+           ((bits & 0x00FF000000000000ULL) >> 40) | ((bits & 0xFF00000000000000ULL) >> 56);
+    memcpy(points->xy + i, &bits, sizeof(bits));
+  }
+  munmap(map, bytes);
+  return 1;
+}
+
+/*Function to read a text file of coordinates on numThreads threads(0 uses every core). The mapped text is split into one
+chunk per thread, each split moved forward to the next separator so no number is cut in two, and the chunks are
+parsed in parallel and joined in order. Returns 0 on failure*/
+static inline int readPointsText(const char *path, pointBuffer *points, unsigned numThreads)
+{
+  struct stat info;
+  int fd = open(path, O_RDONLY);
+  memset(points, 0, sizeof(*points));
+  if(fd < 0 || fstat(fd, &info) != 0)
+  {
+    fprintf(stderr, "Error: cannot open %s\n", path);
+    if(fd >= 0)
+      close(fd);
+    return 0;
+  }
+  size_t bytes = info.st_size;
+  if(bytes == 0)
+  {
+    close(fd);
+    return 1;
+  }
+  const char *text = (const char *)mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(text == (const char *)MAP_FAILED)
+  {
+    fprintf(stderr, "Error: cannot map %s\n", path);
+    return 0;
+  }
+  madvise((void *)text, bytes, MADV_SEQUENTIAL);
+  if(numThreads == 0)
+  {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    numThreads = cores > 0 ? (unsigned)cores : 1;
+  }
+  unsigned numChunks = numThreads;
+  if(numChunks > POINT_FILE_MAX_THREADS)
+    numChunks = POINT_FILE_MAX_THREADS;
+  if(numChunks > bytes / POINT_FILE_MIN_CHUNK)
+    numChunks = bytes / POINT_FILE_MIN_CHUNK ? (unsigned)(bytes / POINT_FILE_MIN_CHUNK) : 1;
+  numberChunk chunks[POINT_FILE_MAX_THREADS];
+  pthread_t threads[POINT_FILE_MAX_THREADS];
+  const char *begin = text, *end = text + bytes;
+  unsigned c;
+  for(c = 0; c < numChunks; c++)
+  {
+    const char *split = (c + 1 == numChunks) ? end : text + bytes / numChunks * (c + 1);
+    while(split < end && inNumber(*split))//Do not cut a number in two
+      split++;
+    if(split < begin)
+      split = begin;
+    memset(&chunks[c], 0, sizeof(numberChunk));
+    chunks[c].begin = begin;
+    chunks[c].end = split;
+    chunks[c].ok = 1;
+    begin = split;
+  }
+  for(c = 1; c < numChunks; c++)
+  {
+    if(pthread_create(&threads[c], NULL, parseChunkThread, &chunks[c]) != 0)//No thread, parse it here when joining
+      threads[c] = pthread_self();
+  }
+  parseChunkThread(&chunks[0]);
+  for(c = 1; c < numChunks; c++)
+  {
+    if(pthread_equal(threads[c], pthread_self()))
+      parseChunkThread(&chunks[c]);
+    else
+      pthread_join(threads[c], NULL);
+  }
+  munmap((void *)text, bytes);
+  return collectChunks(chunks, numChunks, points);
+}
+
+/*Function to read coordinates streamed as text from a FILE such as stdin until the end of the stream. The stream is read
+in blocks, a number cut off by the end of a block is carried over to the next one. Returns 0 on failure*/
+static inline int readPointsStream(FILE *stream, pointBuffer *points)
+{
+  char *block = (char *)malloc(POINT_FILE_BLOCK);
+  numberChunk chunk;
+  size_t carried = 0;//Bytes of a cut off number at the start of the block
+  memset(points, 0, sizeof(*points));
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.ok = block != NULL;
+  while(chunk.ok)
+  {
+    size_t length = carried + fread(block + carried, 1, POINT_FILE_BLOCK - carried, stream);
+    int complete = length < POINT_FILE_BLOCK;//Short read: end of the stream
+    const char *tail = parseChunk(&chunk, block, block + length, complete);
+    if(complete)
+      break;
+    carried = block + length - tail;
+    if(carried == POINT_FILE_BLOCK)//A single "number" fills the whole block
+      chunk.ok = 0;
+    else
+      memmove(block, tail, carried);
+  }
+  free(block);
+  return collectChunks(&chunk, 1, points);
+}
+
+//Function to release the memory of a pointBuffer
+static inline void freePoints(pointBuffer *points)
+{
+  if(points->map != NULL)
+    munmap(points->map, points->mapBytes);
+  else
+    free(points->xy);
+  memset(points, 0, sizeof(*points));
+}
+
+#endif
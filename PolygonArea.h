@@ -0,0 +1,187 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*PolygonArea - the polygonal area formula(Green's Theorem for a polygon) shared by every version of the project.
+Written in C so PA3 can use it too. Coordinates are read straight from the caller's storage: x[i * stride] and
+y[i * stride] is vertex i, so stride = 1 reads separate x and y arrays and stride = 2 reads arrays of points
+(point, pair<double,double> or PA3's interleaved x,y array) without copying them*/
+
+#ifndef POLYGON_AREA_H
+#define POLYGON_AREA_H
+
+#include <stddef.h>
+#include <math.h>
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+/*Accuracy: every vertex is taken relative to vertex 0, which removes the cancellation between large coordinates of
+shapes far from the origin, each cross product x_i*y_j - y_i*x_j is computed with an FMA correction term, and the
+sum is accumulated with Neumaier(improved Kahan) compensation in 4 independent lanes. After the shift vertex 0 is the
+origin, so the closing edge(last vertex back to vertex 0) contributes nothing and the loop needs no wrap-around branch*/
+
+//Function to add v to the compensated sum (sum, comp)
+static inline void neumaierAdd(double *sum, double *comp, double v)
+{
+  double t = *sum + v;
+  if(fabs(*sum) >= fabs(v))
+    *comp += (*sum - t) + v;
+  else
+    *comp += (v - t) + *sum;
+  *sum = t;
+}
+
+//Function to calculate a*b - c*d accurately
+static inline double crossDiff(double a, double b, double c, double d)
+{
+  double w = c * d;
+  double e = fma(c, d, -w);//Rounding error of c*d
+  return fma(a, b, -w) - e;
+}
+
+/*Function to calculate twice the signed area of the polygon with n vertices(positive if the vertices go
+counterclockwise). Vertex i is (x[i * stride], y[i * stride])*/
+static inline double signedPolygonArea2(const double *x, const double *y, size_t n, size_t stride)
+{
+  if(n < 3)
+    return 0.0;
+  double x0 = x[0], y0 = y[0];
+  double sum[4] = {0.0, 0.0, 0.0, 0.0};//Lane sums
+  double comp[4] = {0.0, 0.0, 0.0, 0.0};//Lane compensations
+  size_t i = 0;//Next edge(i, i + 1) to add
+#if defined(__AVX2__) && defined(__FMA__)
+  if(stride == 1 || (stride == 2 && y == x + 1))
+  {
+    __m256d vx0 = _mm256_set1_pd(x0), vy0 = _mm256_set1_pd(y0);
+    __m256d vsum = _mm256_setzero_pd(), vcomp = _mm256_setzero_pd();
+    __m256d signMask = _mm256_set1_pd(-0.0);
+    for(; i + 4 < n; i += 4)//Edges i..i+3, needs vertices i..i+4
+    {
+      __m256d xa, ya, xb, yb;//Vertices i+k and i+k+1 in each lane
+      if(stride == 1)
+      {
+        xa = _mm256_loadu_pd(x + i);
+        ya = _mm256_loadu_pd(y + i);
+        xb = _mm256_loadu_pd(x + i + 1);
+        yb = _mm256_loadu_pd(y + i + 1);
+      }
+      else//Interleaved x,y: unpacking gives the lanes in order i, i+2, i+1, i+3, the same for both vertices of an edge
+      {
+        __m256d p0 = _mm256_loadu_pd(x + 2 * i), p1 = _mm256_loadu_pd(x + 2 * i + 4);
+        __m256d q0 = _mm256_loadu_pd(x + 2 * i + 2), q1 = _mm256_loadu_pd(x + 2 * i + 6);
+        xa = _mm256_unpacklo_pd(p0, p1);
+        ya = _mm256_unpackhi_pd(p0, p1);
+        xb = _mm256_unpacklo_pd(q0, q1);
+        yb = _mm256_unpackhi_pd(q0, q1);
+      }
+      xa = _mm256_sub_pd(xa, vx0);
+      ya = _mm256_sub_pd(ya, vy0);
+      xb = _mm256_sub_pd(xb, vx0);
+      yb = _mm256_sub_pd(yb, vy0);
+      __m256d w = _mm256_mul_pd(ya, xb);
+      __m256d e = _mm256_fmsub_pd(ya, xb, w);
+      __m256d v = _mm256_sub_pd(_mm256_fmsub_pd(xa, yb, w), e);//Cross products
+      __m256d t = _mm256_add_pd(vsum, v);
+      __m256d bigSum = _mm256_cmp_pd(_mm256_andnot_pd(signMask, vsum), _mm256_andnot_pd(signMask, v), _CMP_GE_OQ);
+      __m256d c1 = _mm256_add_pd(_mm256_sub_pd(vsum, t), v);
+      __m256d c2 = _mm256_add_pd(_mm256_sub_pd(v, t), vsum);
+      vcomp = _mm256_add_pd(vcomp, _mm256_blendv_pd(c2, c1, bigSum));
+      vsum = t;
+    }
+    _mm256_storeu_pd(sum, vsum);
+    _mm256_storeu_pd(comp, vcomp);
+  }
+#endif
+  for(; i + 4 < n; i += 4)//Same 4 lane loop for any stride
+  {
+    int k;
+    for(k = 0; k < 4; k++)
+    {
+      size_t a = (i + k) * stride, b = (i + k + 1) * stride;
+      neumaierAdd(&sum[k], &comp[k], crossDiff(x[a] - x0, y[b] - y0, y[a] - y0, x[b] - x0));
+    }
+  }
+  double total = 0.0, totalComp = 0.0;
+  int k;
+  for(k = 0; k < 4; k++)
+  {
+    neumaierAdd(&total, &totalComp, sum[k]);
+    neumaierAdd(&total, &totalComp, comp[k]);
+  }
+  for(; i + 1 < n; i++)//Remaining edges
+  {
+    size_t a = i * stride, b = (i + 1) * stride;
+    neumaierAdd(&total, &totalComp, crossDiff(x[a] - x0, y[b] - y0, y[a] - y0, x[b] - x0));
+  }
+  //Closing edge from the last vertex back to vertex 0 is zero since vertex 0 is the origin after the shift
+  return total + totalComp;
+}
+
+//Function to calculate the area enclosed by a polygon with n vertices, vertex i is (x[i * stride], y[i * stride])
+static inline double polygonArea(const double *x, const double *y, size_t n, size_t stride)
+{
+  return fabs(signedPolygonArea2(x, y, n, stride)) / 2;
+}
+
+/*Streaming version of the same formula for traversals that produce the boundary one vertex at a time. Only the first
+and previous vertices are kept, so the area comes out of the traversal itself with O(1) memory*/
+typedef struct {
+  double x0, y0;//First vertex, every vertex is taken relative to it
+  double px, py;//Previous vertex relative to the first
+  double sum, comp;//Compensated sum of the cross products
+  size_t count;//Number of vertices added
+} areaAccumulator;
+
+//Function to start a new polygon
+static inline void areaInit(areaAccumulator *acc)
+{
+  acc->x0 = acc->y0 = acc->px = acc->py = 0.0;
+  acc->sum = acc->comp = 0.0;
+  acc->count = 0;
+}
+
+//Function to add the next vertex of the polygon
+static inline void areaAddVertex(areaAccumulator *acc, double x, double y)
+{
+  if(acc->count == 0)
+  {
+    acc->x0 = x;
+    acc->y0 = y;
+  }
+  double dx = x - acc->x0, dy = y - acc->y0;
+  neumaierAdd(&acc->sum, &acc->comp, crossDiff(acc->px, dy, acc->py, dx));//Edge from the previous vertex
+  acc->px = dx;
+  acc->py = dy;
+  acc->count++;
+}
+
+/*Function to append a chain of vertices accumulated separately(a boundary segment traced on another thread) to acc.
+In the frame of acc's first vertex the chain's edges sum to seg's sum plus cross(a, b) of its first and last vertex a, b*/
+static inline void areaAppend(areaAccumulator *acc, const areaAccumulator *seg)
+{
+  if(seg->count == 0)
+    return;
+  if(acc->count == 0)
+  {
+    *acc = *seg;
+    return;
+  }
+  double ax = seg->x0 - acc->x0, ay = seg->y0 - acc->y0;//First and last vertex of the chain relative to acc's first
+  double bx = ax + seg->px, by = ay + seg->py;
+  neumaierAdd(&acc->sum, &acc->comp, crossDiff(acc->px, ay, acc->py, ax));//Edge joining the two chains
+  neumaierAdd(&acc->sum, &acc->comp, seg->sum);
+  neumaierAdd(&acc->sum, &acc->comp, seg->comp);
+  neumaierAdd(&acc->sum, &acc->comp, crossDiff(ax, by, ay, bx));
+  acc->px = bx;
+  acc->py = by;
+  acc->count += seg->count;
+}
+
+//Function to obtain the area enclosed by the vertices added so far, the closing edge contributes nothing
+static inline double areaResult(const areaAccumulator *acc)
+{
+  return fabs(acc->sum + acc->comp) / 2;
+}
+
+#endif
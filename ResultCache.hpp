@@ -0,0 +1,172 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*ResultCache - memo of computed shapes, so a shape that was already computed costs a hash lookup. The key is a canonical
+text of the shape built by each program(its functionStruct list with every number printed exactly and the functions
+without whitespace, plus the accuracy settings the result depends on), the value the area, the number of boundary points
+and, if the program kept them, the ordered boundary points. Entries live in memory(at most maxEntries, the oldest is dropped
+first) and, if dir is set, also as one file per key in dir named by the 64 bit FNV-1a hash of the key, so the memo
+survives restarts and can be shared by several processes. The key is stored in the file too and compared on load, two
+keys with the same hash just overwrite each other's file*/
+
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+#include <cinttypes>
+#include <cctype>
+#include <unistd.h>
+#include "Instrument.hpp"
+
+/*****************************Structure Definitions**************************/
+//Result of one shape as kept in the memo
+struct memoEntry {
+    double area;
+    size_t points;//Number of boundary points
+    std::vector<double> xy;//Ordered boundary points as x,y pairs, empty unless they were kept
+};
+
+//Memo of computed shapes, shared by every worker thread
+struct resultMemo {
+    std::mutex lock;
+    std::unordered_map<std::string, memoEntry> entries;
+    std::deque<std::string> order;//Keys from oldest to newest, for dropping entries
+    size_t maxEntries;
+    std::string dir;//Directory of the on-disk store, empty for memory only
+    resultMemo() : maxEntries(1 << 16) {}
+};
+
+/**********************Function Declarations**********************************/
+uint64_t memoHash(const std::string &);//Function to hash a key
+std::string memoNumber(double);//Function to print a number exactly for a key
+std::string memoFunction(const std::string &);//Function to bring a function string into canonical form for a key
+std::string memoPath(const resultMemo &, const std::string &);//Function to find the file of a key in the on-disk store
+void memoInsert(resultMemo &, const std::string &, const memoEntry &);//Function to add an entry to the in-memory part
+bool memoLookup(resultMemo &, const std::string &, bool, memoEntry &);//Function to look up the result of a shape
+void memoStore(resultMemo &, const std::string &, const memoEntry &);//Function to add the result of a shape
+
+//Function to hash a key with 64 bit FNV-1a
+inline uint64_t memoHash(const std::string &key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+    for(i = 0; i < key.size(); i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//Function to print a number for a key, with enough digits that different doubles never give the same text
+inline std::string memoNumber(double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.17g", value == 0.0 ? 0.0 : value);//-0 and 0 give the same result
+    return text;
+}
+
+//Function to bring a function string into canonical form for a key: whitespace does not change the function, so drop it
+inline std::string memoFunction(const std::string &function)
+{
+    std::string canonical;
+    size_t i;
+    for(i = 0; i < function.size(); i++)
+    {
+        if(!isspace((unsigned char)function[i]))
+            canonical += function[i];
+    }
+    return canonical;
+}
+
+//Function to find the file of a key in the on-disk store
+inline std::string memoPath(const resultMemo &memo, const std::string &key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".memo", memoHash(key));
+    return memo.dir + "/" + name;
+}
+
+//Function to add an entry to the in-memory part of the memo, dropping the oldest entries beyond maxEntries
+inline void memoInsert(resultMemo &memo, const std::string &key, const memoEntry &entry)
+{
+    std::lock_guard<std::mutex> guard(memo.lock);
+    if(memo.entries.count(key) == 0)
+    {
+        while(!memo.order.empty() && memo.entries.size() >= memo.maxEntries)
+        {
+            memo.entries.erase(memo.order.front());
+            memo.order.pop_front();
+        }
+        memo.order.push_back(key);
+    }
+    memo.entries[key] = entry;
+}
+
+/*Function to look up the result of a shape, first in memory, then in the on-disk store. With needPoints set an entry
+without boundary points counts as a miss. Returns true and fills entry on a hit*/
+inline bool memoLookup(resultMemo &memo, const std::string &key, bool needPoints, memoEntry &entry)
+{
+    INSTRUMENT_STAGE(MEMO);
+    {
+        std::lock_guard<std::mutex> guard(memo.lock);
+        std::unordered_map<std::string, memoEntry>::const_iterator found = memo.entries.find(key);
+        if(found != memo.entries.end() && (!needPoints || !found->second.xy.empty()))
+        {
+            entry = found->second;
+            return true;
+        }
+    }
+    if(memo.dir.empty())
+        return false;
+    FILE *file = fopen(memoPath(memo, key).c_str(), "r");
+    if(file == NULL)
+        return false;
+    std::string storedKey;
+    int c;
+    while((c = fgetc(file)) != EOF && c != '\n')
+        storedKey += (char)c;
+    size_t numXY = 0, i;
+    bool ok = storedKey == key && fscanf(file, "%lf %zu %zu", &entry.area, &entry.points, &numXY) == 3;
+    entry.xy.resize(ok ? numXY : 0);
+    for(i = 0; ok && i < numXY; i++)
+        ok = fscanf(file, "%lf", &entry.xy[i]) == 1;
+    fclose(file);
+    if(!ok || (needPoints && entry.xy.empty()))
+        return false;
+    memoInsert(memo, key, entry);//Keep it in memory for the next lookup
+    return true;
+}
+
+/*Function to add the result of a shape to the memo, and to the on-disk store if there is one. The file is written under
+a temporary name and renamed, so a reader never sees half of it*/
+inline void memoStore(resultMemo &memo, const std::string &key, const memoEntry &entry)
+{
+    INSTRUMENT_STAGE(MEMO);
+    memoInsert(memo, key, entry);
+    if(memo.dir.empty())
+        return;
+    std::string path = memoPath(memo, key);
+    std::string temporary = path + "." + std::to_string((long)getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    FILE *file = fopen(temporary.c_str(), "w");
+    if(file == NULL)
+        return;
+    fprintf(file, "%s\n%.17g %zu %zu\n", key.c_str(), entry.area, entry.points, entry.xy.size());
+    size_t i;
+    for(i = 0; i < entry.xy.size(); i++)
+        fprintf(file, "%.17g%c", entry.xy[i], i % 2 ? '\n' : ' ');
+    bool ok = fclose(file) == 0;
+    if(!ok || rename(temporary.c_str(), path.c_str()) != 0)
+        unlink(temporary.c_str());
+}
+
+#endif
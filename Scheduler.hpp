@@ -0,0 +1,203 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*Scheduler - work-stealing task pool for batches of shapes whose costs differ by orders of magnitude. Every worker has
+its own deque of tasks: it pushes the tasks it spawns onto the back and takes its next task from the back(the newest, whose
+data is still in cache), and a worker whose deque is empty steals the oldest task from the front of another worker's
+deque. A shape that is split into segment tasks therefore keeps its own worker busy, while idle workers take over the
+segments it has not started yet, and no core sits idle behind one expensive shape.
+Tasks belong to a taskGroup, poolWait runs tasks(its own or stolen ones) until every task of the group is done, so a task
+may spawn and wait for subtasks without blocking a worker. Once there is nothing left to steal the waiting thread sleeps
+until the last task of the group ends, looking for new tasks every POOL_WAIT_POLL.
+    workStealingPool pool;
+    poolStart(pool, 0);//The calling thread is worker 0
+    taskGroup group;
+    poolSpawn(pool, group, [&]() { ... });
+    poolWait(pool, group);
+    poolStop(pool);*/
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include "Instrument.hpp"
+
+const std::chrono::microseconds POOL_WAIT_POLL(500);//How long poolWait sleeps before it looks for tasks to steal again
+
+/*****************************Structure Definitions**************************/
+//Tasks of one worker, the owner works at the back and thieves take from the front
+struct taskQueue {
+    std::mutex lock;
+    std::deque< std::function<void()> > tasks;
+};
+
+//Set of tasks someone waits for
+struct taskGroup {
+    std::atomic<size_t> pending;//Tasks spawned and not finished yet
+    std::mutex lock;//Held while the last tasks finish, so the group outlives the notify
+    std::condition_variable done;//Notified when pending drops to 0
+    taskGroup() : pending(0) {}
+};
+
+//Worker threads and their deques
+struct workStealingPool {
+    std::vector< std::unique_ptr<taskQueue> > queues;//One per worker, queues[0] belongs to the thread that started the pool
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queued;//Tasks waiting in all the deques
+    std::atomic<unsigned> nextQueue;//Deque for the next task spawned by a thread that is not a worker
+    std::atomic<bool> stop;
+    std::mutex sleepLock;//Idle workers sleep on wake until a task is spawned
+    std::condition_variable wake;
+    workStealingPool() : queued(0), nextQueue(0), stop(false) {}
+};
+
+/**********************Function Declarations**********************************/
+int &poolWorkerIndex();//Function to obtain the worker index of the calling thread
+workStealingPool *&activePool();//Function to obtain the pool batch shapes may split their work onto
+void poolStart(workStealingPool &, unsigned);//Function to start the worker threads
+void poolSpawn(workStealingPool &, taskGroup &, std::function<void()>);//Function to add a task
+bool poolRunOne(workStealingPool &, int);//Function to run one task, own or stolen
+void poolWait(workStealingPool &, taskGroup &);//Function to run tasks until every task of a group is done
+void poolWorker(workStealingPool *, int);//Function run by each worker thread
+void poolStop(workStealingPool &);//Function to stop the worker threads
+
+//Function to obtain the worker index of the calling thread, -1 if it is not a worker of a running pool
+inline int &poolWorkerIndex()
+{
+    static thread_local int index = -1;
+    return index;
+}
+
+//Function to obtain the pool batch shapes may split their work onto, NULL outside a batch
+inline workStealingPool *&activePool()
+{
+    static workStealingPool *pool = NULL;
+    return pool;
+}
+
+//Function to start numThreads workers(0 uses every core), the calling thread is worker 0 until poolStop
+inline void poolStart(workStealingPool &pool, unsigned numThreads)
+{
+    if(numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    pool.stop = false;
+    unsigned t;
+    for(t = 0; t < numThreads; t++)
+        pool.queues.push_back(std::unique_ptr<taskQueue>(new taskQueue()));
+    poolWorkerIndex() = 0;
+    for(t = 1; t < numThreads; t++)
+        pool.threads.push_back(std::thread(poolWorker, &pool, (int)t));
+}
+
+/*Function to add a task to group. A worker pushes onto its own deque, any other thread spreads its tasks over the deques
+round robin. queued is counted before the task is published, so a thief that takes it at once never makes it wrap*/
+inline void poolSpawn(workStealingPool &pool, taskGroup &group, std::function<void()> task)
+{
+    INSTRUMENT_WRAP(task);//Counts of the task go to the shape that spawned it
+    group.pending++;
+    int self = poolWorkerIndex();
+    size_t q = self >= 0 ? (size_t)self : pool.nextQueue.fetch_add(1) % pool.queues.size();
+    taskGroup *owner = &group;
+    {
+        std::lock_guard<std::mutex> guard(pool.sleepLock);//No worker can miss the task between its check and its wait
+        pool.queued++;
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool.queues[q]->lock);
+        pool.queues[q]->tasks.push_back([owner, task]() {
+            task();
+            std::lock_guard<std::mutex> guard(owner->lock);
+            if(--owner->pending == 0)
+                owner->done.notify_all();
+        });
+    }
+    pool.wake.notify_one();
+}
+
+/*Function to run one task: the newest task of worker self's own deque, or else the oldest task of the first other deque
+that has one. Returns false if every deque is empty*/
+inline bool poolRunOne(workStealingPool &pool, int self)
+{
+    std::function<void()> task;
+    size_t n = pool.queues.size(), k;
+    for(k = 0; k < n && !task; k++)
+    {
+        size_t q = ((self >= 0 ? (size_t)self : 0) + k) % n;
+        taskQueue &queue = *pool.queues[q];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if(queue.tasks.empty())
+            continue;
+        if(k == 0 && self >= 0)//Own deque, newest first
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else//Steal the oldest
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if(!task)
+        return false;
+    pool.queued--;
+    task();
+    return true;
+}
+
+/*Function to run tasks on the calling thread until every task of group is done. When no task can be run the rest of the
+group is running on other workers: sleep until it is done, waking every POOL_WAIT_POLL in case they spawn tasks to steal*/
+inline void poolWait(workStealingPool &pool, taskGroup &group)
+{
+    while(group.pending > 0)
+    {
+        if(poolRunOne(pool, poolWorkerIndex()))
+            continue;
+        std::unique_lock<std::mutex> guard(group.lock);
+        group.done.wait_for(guard, POOL_WAIT_POLL, [&group]() { return group.pending == 0; });
+    }
+    std::lock_guard<std::mutex> guard(group.lock);//The task that finished last is out of the group before it goes away
+}
+
+//Function run by each worker thread: runs and steals tasks, sleeps while there are none
+inline void poolWorker(workStealingPool *pool, int self)
+{
+    poolWorkerIndex() = self;
+    while(true)
+    {
+        if(poolRunOne(*pool, self))
+            continue;
+        std::unique_lock<std::mutex> guard(pool->sleepLock);
+        pool->wake.wait(guard, [pool]() { return pool->stop || pool->queued > 0; });
+        if(pool->stop)
+            return;
+    }
+}
+
+//Function to stop the worker threads once they are idle, tasks still queued are not run
+inline void poolStop(workStealingPool &pool)
+{
+    {
+        std::lock_guard<std::mutex> guard(pool.sleepLock);
+        pool.stop = true;
+    }
+    pool.wake.notify_all();
+    size_t t;
+    for(t = 0; t < pool.threads.size(); t++)
+        pool.threads[t].join();
+    pool.threads.clear();
+    pool.queues.clear();
+    poolWorkerIndex() = -1;
+}
+
+#endif
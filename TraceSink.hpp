@@ -0,0 +1,205 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*TraceSink - records every boundary point a traversal finds without slowing the traversal down, so the full path of a
+shape can be looked at when debugging. Off by default: traceOpen starts it. A traversal asks for a path number with
+traceBegin and hands its points to tracePoint, which only copies them into a small buffer of the calling thread. Full
+buffers(and the rest of a buffer at traceFlush, the end of a traversal) are moved into a ring buffer, and a background
+writer drains the ring into the trace file, so the traversal never waits for the file unless the writer falls a whole
+ring behind.
+    traceOpen("trace.csv");//path,x,y per line with every number printed exactly
+    traceOpen("trace.bin");//Raw records: uint64 path, float64 x, float64 y in native byte order, 24 bytes each
+Points of one path are in order, paths traced at the same time on different threads are interleaved in chunks*/
+
+#ifndef TRACE_SINK_HPP
+#define TRACE_SINK_HPP
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+/*****************************Structure Definitions**************************/
+//One point of one path
+struct traceRecord {
+    uint64_t path;
+    double x;
+    double y;
+};
+
+const size_t TRACE_CHUNK = 256;//Points a thread collects before moving them into the ring
+const size_t TRACE_RING_SIZE = 1 << 16;//Points the ring holds
+
+//Points of the calling thread not yet moved into the ring
+struct traceBuffer {
+    traceRecord records[TRACE_CHUNK];
+    size_t count;
+};
+
+//Ring buffer and its writer
+struct traceSink {
+    std::vector<traceRecord> ring;
+    size_t head, tail;//Points ever added and ever written, ring position is modulo TRACE_RING_SIZE
+    std::mutex lock;
+    std::condition_variable ready;//Signals the writer that there are points or that the sink is closing
+    std::condition_variable space;//Signals threads waiting for room in the ring
+    std::thread writer;
+    FILE *file;
+    bool binary;
+    bool stop;
+    std::atomic<bool> enabled;
+    std::atomic<uint64_t> nextPath;
+    traceSink() : head(0), tail(0), file(NULL), binary(false), stop(false), enabled(false), nextPath(0) {}
+};
+
+/**********************Function Declarations**********************************/
+traceSink &traceSinkOf();//Function to obtain the trace sink of the program
+traceBuffer &traceBufferOf();//Function to obtain the buffer of the calling thread
+bool traceEnabled();//Function to determine if points are being recorded
+bool traceOpen(const char *);//Function to start recording points into a file
+uint64_t traceBegin();//Function to obtain the number of a new path
+void tracePoint(uint64_t, double, double);//Function to record the next point of a path
+void traceFlush();//Function to move the points of the calling thread into the ring
+void traceWriter(traceSink *);//Function run by the writer thread
+void traceClose();//Function to write the remaining points and close the file
+
+//Function to obtain the trace sink of the program
+inline traceSink &traceSinkOf()
+{
+    static traceSink sink;
+    return sink;
+}
+
+//Function to obtain the buffer of the calling thread
+inline traceBuffer &traceBufferOf()
+{
+    static thread_local traceBuffer buffer = {{}, 0};
+    return buffer;
+}
+
+//Function to determine if points are being recorded, traversals check this once before they start
+inline bool traceEnabled()
+{
+    return traceSinkOf().enabled.load(std::memory_order_relaxed);
+}
+
+/*Function to start recording points into the file at path, binary records if path ends in .bin and CSV otherwise. The file
+is closed when the program exits. Returns false if the file cannot be opened*/
+inline bool traceOpen(const char *path)
+{
+    traceSink &sink = traceSinkOf();
+    if(sink.enabled)
+        return false;
+    std::string name = path;
+    sink.binary = name.size() >= 4 && name.compare(name.size() - 4, 4, ".bin") == 0;
+    sink.file = fopen(path, sink.binary ? "wb" : "w");
+    if(sink.file == NULL)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return false;
+    }
+    if(!sink.binary)
+        fprintf(sink.file, "path,x,y\n");
+    sink.ring.resize(TRACE_RING_SIZE);
+    sink.head = sink.tail = 0;
+    sink.stop = false;
+    sink.writer = std::thread(traceWriter, &sink);
+    sink.enabled = true;
+    atexit(traceClose);
+    return true;
+}
+
+//Function to obtain the number of a new path, one per traversal of a segment
+inline uint64_t traceBegin()
+{
+    return traceSinkOf().nextPath.fetch_add(1) + 1;
+}
+
+//Function to record the next point of path, only a copy into the buffer of the calling thread unless the buffer is full
+inline void tracePoint(uint64_t path, double x, double y)
+{
+    traceBuffer &buffer = traceBufferOf();
+    traceRecord &record = buffer.records[buffer.count++];
+    record.path = path;
+    record.x = x;
+    record.y = y;
+    if(buffer.count == TRACE_CHUNK)
+        traceFlush();
+}
+
+/*Function to move the points of the calling thread into the ring. Called when the buffer is full and at the end of every
+traversal, so no points are left behind in the buffer of a thread that exits. Waits only if the ring is full*/
+inline void traceFlush()
+{
+    traceBuffer &buffer = traceBufferOf();
+    traceSink &sink = traceSinkOf();
+    size_t done = 0;
+    while(done < buffer.count)
+    {
+        std::unique_lock<std::mutex> guard(sink.lock);
+        sink.space.wait(guard, [&sink]() { return sink.head - sink.tail < TRACE_RING_SIZE; });
+        size_t n = std::min(buffer.count - done, TRACE_RING_SIZE - (sink.head - sink.tail));
+        size_t i;
+        for(i = 0; i < n; i++)
+            sink.ring[(sink.head + i) % TRACE_RING_SIZE] = buffer.records[done + i];
+        sink.head += n;
+        done += n;
+        sink.ready.notify_one();
+    }
+    buffer.count = 0;
+}
+
+/*Function run by the writer thread: writes the points between tail and head, then frees their part of the ring. Points
+are written outside the lock, threads only add points to the part of the ring the writer is not reading*/
+inline void traceWriter(traceSink *sink)
+{
+    std::unique_lock<std::mutex> guard(sink->lock);
+    while(true)
+    {
+        sink->ready.wait(guard, [sink]() { return sink->head != sink->tail || sink->stop; });
+        if(sink->head == sink->tail)//Stopped and everything is written
+            return;
+        size_t start = sink->tail % TRACE_RING_SIZE;
+        size_t n = std::min(sink->head - sink->tail, TRACE_RING_SIZE - start);//Up to the end of the ring
+        guard.unlock();
+        const traceRecord *records = &sink->ring[start];
+        size_t i;
+        if(sink->binary)
+            fwrite(records, sizeof(traceRecord), n, sink->file);
+        else
+        {
+            for(i = 0; i < n; i++)
+                fprintf(sink->file, "%llu,%.17g,%.17g\n", (unsigned long long)records[i].path, records[i].x, records[i].y);
+        }
+        guard.lock();
+        sink->tail += n;
+        sink->space.notify_all();
+    }
+}
+
+//Function to write the points still in the buffer of the calling thread and in the ring, then close the file
+inline void traceClose()
+{
+    traceSink &sink = traceSinkOf();
+    if(!sink.enabled)
+        return;
+    traceFlush();
+    {
+        std::lock_guard<std::mutex> guard(sink.lock);
+        sink.stop = true;
+    }
+    sink.ready.notify_one();
+    sink.writer.join();
+    fclose(sink.file);
+    sink.file = NULL;
+    sink.enabled = false;
+}
+
+#endif
@@ -0,0 +1,423 @@
+/*Eric Gelphman
+  University of California, San Diego Department of Physics
+  Matthew Uffenheimer
+  University of California, Santa Barbara College of Creative Studies(CCS)*/
+/*ZeroSet - finds the whole boundary f(x,y) = 0 inside a box without start points, as closed polygons around the region
+f(x,y) < 0. The box is the root of a quadtree whose leaves are cells of at most cellSize on each side. A cell is only
+split if f changes sign at its corners or its interval bound(see Interval.hpp) holds 0, so cells the boundary cannot pass
+through are dropped whole and the work grows with the length of the boundary instead of the area of the box. Leaves are
+contoured with marching squares(the saddle cases decided by the mean of the corners) and the segments are linked into
+closed polygons: counterclockwise around each component of f < 0 and clockwise around its holes, so their signed areas
+add up to the area of the region. Where the region reaches the edge of the box, the polygon follows the edge.
+Every leaf has the same size, and a crossing is computed from the values at the two ends of its edge, so the two leaves
+sharing an edge find exactly the same point and segments are linked by the edge they cross, without any epsilon.
+Subtrees are tasks of the active work-stealing pool(see Scheduler.hpp) when there is one, so the evaluator is called from
+several threads at once and must be thread-safe(each thread using its own compiled expressions).
+    zeroSetResult result;
+    zeroSetExtract("x*x+y*y-4", evaluator, -3.0, 3.0, -3.0, 3.0, 0.05, result);//One polygon, result.area close to 4 pi
+Functions the expression tree cannot parse have no interval bound, every cell of their box is visited*/
+
+#ifndef ZERO_SET_HPP
+#define ZERO_SET_HPP
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "PolygonArea.h"
+#include "ExpressionTree.hpp"
+#include "Interval.hpp"
+#include "Scheduler.hpp"
+#include "Instrument.hpp"
+
+/*****************************Structure Definitions**************************/
+//Point structure for a point (x,y), the same layout as the point types of the programs
+struct zeroSetPoint {
+    double x;
+    double y;
+};
+
+//Function to evaluate f(x,y) at n points: values[i] = f(xs[i], ys[i])
+typedef std::function<void(const double *, const double *, double *, int)> zeroSetEvaluator;
+
+const int ZEROSET_MAX_DEPTH = 20;//Deepest quadtree level, at most 2^20 leaves along each side of the box
+const long long ZEROSET_TASK_SIZE = 32;//Cells at least this many leaves wide split into tasks when there is a pool
+
+/*Quadtree over the box. Lattice point (i,j), 0 <= i,j <= n, is (xmin + i dx, ymin + j dy), computed the same way
+everywhere so shared corners of cells get the same coordinates and values*/
+struct zeroSetGrid {
+    double xmin, ymin, dx, dy;
+    long long n;//Leaves along each side, a power of 2
+    exprTree tree;//Expression tree of f(x,y) for the interval bounds
+    bool bounded;//Set if tree parsed, otherwise no cell can be dropped
+    const zeroSetEvaluator *evaluate;
+};
+
+//Square of size x size leaves with its lower left corner at lattice point (i,j)
+struct zeroSetCell {
+    long long i, j, size;
+    double f[4];//f at the corners (i,j), (i+size,j), (i+size,j+size), (i,j+size), counterclockwise
+};
+
+/*Directed piece of the boundary inside one leaf, with f < 0 on its left. It goes from the crossing on edge from to the
+crossing on edge to. Edge key: 2 * (j * (n + 1) + i) for the edge from (i,j) to (i+1,j), plus 1 for (i,j) to (i,j+1)*/
+struct zeroSetSegment {
+    uint64_t from, to;
+    zeroSetPoint a, b;
+};
+
+//Segments and number of cells visited by one subtree
+struct zeroSetOutput {
+    std::vector<zeroSetSegment> segments;
+    size_t cells;
+    zeroSetOutput() : cells(0) {}
+};
+
+struct zeroSetResult {
+    std::vector< std::vector<zeroSetPoint> > polygons;//Closed polygons, the last vertex connects back to the first
+    double area;//Area of the region f(x,y) < 0 inside the box
+    size_t cells;//Quadtree cells visited
+    size_t points;//Vertices of all polygons
+};
+
+/**********************Function Declarations**********************************/
+double zeroSetX(const zeroSetGrid &, long long);//Function to obtain the x-coordinate of lattice column i
+double zeroSetY(const zeroSetGrid &, long long);//Function to obtain the y-coordinate of lattice row j
+bool zeroSetInside(double);//Function to determine if a value of f is inside the region
+uint64_t zeroSetEdge(const zeroSetGrid &, long long, long long, bool);//Function to obtain the key of a lattice edge
+zeroSetPoint zeroSetCrossing(const zeroSetGrid &, long long, long long, bool, double, double);//Function to find where f = 0 on an edge
+void zeroSetLeaf(const zeroSetGrid &, const zeroSetCell &, zeroSetOutput &);//Function to contour one leaf with marching squares
+void zeroSetVisit(const zeroSetGrid &, const zeroSetCell &, zeroSetOutput &);//Function to visit a cell of the quadtree
+double zeroSetBorder(const zeroSetGrid &, uint64_t, const zeroSetPoint &);//Function to obtain the position of a point along the edge of the box
+void zeroSetLink(const zeroSetGrid &, const std::vector<zeroSetSegment> &, double, zeroSetResult &);//Function to link segments into polygons
+bool zeroSetExtract(const std::string &, const zeroSetEvaluator &, double, double, double, double, double, zeroSetResult &);//Function to find the boundary f(x,y) = 0 in a box
+
+//Function to obtain the x-coordinate of lattice column i
+inline double zeroSetX(const zeroSetGrid &grid, long long i)
+{
+    return grid.xmin + i * grid.dx;
+}
+
+//Function to obtain the y-coordinate of lattice row j
+inline double zeroSetY(const zeroSetGrid &grid, long long j)
+{
+    return grid.ymin + j * grid.dy;
+}
+
+//Function to determine if a value of f is inside the region, f = 0 and NaN are outside
+inline bool zeroSetInside(double f)
+{
+    return f < 0.0;
+}
+
+//Function to obtain the key of the edge from lattice point (i,j) to (i+1,j), or to (i,j+1) if vertical is set
+inline uint64_t zeroSetEdge(const zeroSetGrid &grid, long long i, long long j, bool vertical)
+{
+    return 2 * ((uint64_t)j * (uint64_t)(grid.n + 1) + (uint64_t)i) + (vertical ? 1 : 0);
+}
+
+/*Function to find where f = 0 on the edge from (i,j) to (i+1,j), or to (i,j+1) if vertical is set, by linear
+interpolation between fa at (i,j) and fb at the other end. Both leaves sharing the edge call this with the same numbers*/
+inline zeroSetPoint zeroSetCrossing(const zeroSetGrid &grid, long long i, long long j, bool vertical, double fa, double fb)
+{
+    double t = fa / (fa - fb);
+    if(!(t >= 0.0 && t <= 1.0))//NaN at an end, the middle is as good as anything
+        t = 0.5;
+    zeroSetPoint p;
+    p.x = vertical ? zeroSetX(grid, i) : zeroSetX(grid, i) + t * grid.dx;
+    p.y = vertical ? zeroSetY(grid, j) + t * grid.dy : zeroSetY(grid, j);
+    return p;
+}
+
+/*Function to contour one leaf with marching squares. Walking the edges counterclockwise, each edge that leaves the
+region(inside to outside) is joined to an edge that enters it: the next one, or in the saddle cases(two of each) the next
+one if the mean of the corners is inside and the previous one otherwise*/
+inline void zeroSetLeaf(const zeroSetGrid &grid, const zeroSetCell &cell, zeroSetOutput &out)
+{
+    bool in[4];
+    int k, count = 0;
+    for(k = 0; k < 4; k++)
+    {
+        in[k] = zeroSetInside(cell.f[k]);
+        count += in[k];
+    }
+    if(count == 0 || count == 4)
+        return;
+    long long i = cell.i, j = cell.j;
+    uint64_t keys[4] = {zeroSetEdge(grid, i, j, false), zeroSetEdge(grid, i + 1, j, true), zeroSetEdge(grid, i, j + 1, false), zeroSetEdge(grid, i, j, true)};
+    zeroSetPoint points[4];//Crossing on each edge that has one, the lower left end is always the first end
+    if(in[0] != in[1])
+        points[0] = zeroSetCrossing(grid, i, j, false, cell.f[0], cell.f[1]);
+    if(in[1] != in[2])
+        points[1] = zeroSetCrossing(grid, i + 1, j, true, cell.f[1], cell.f[2]);
+    if(in[3] != in[2])
+        points[2] = zeroSetCrossing(grid, i, j + 1, false, cell.f[3], cell.f[2]);
+    if(in[0] != in[3])
+        points[3] = zeroSetCrossing(grid, i, j, true, cell.f[0], cell.f[3]);
+    bool saddle = count == 2 && in[0] == in[2];
+    bool centerInside = zeroSetInside((cell.f[0] + cell.f[1] + cell.f[2] + cell.f[3]) / 4);
+    for(k = 0; k < 4; k++)
+    {
+        if(!(in[k] && !in[(k + 1) % 4]))//Edge k does not leave the region
+            continue;
+        int e;
+        if(saddle)
+            e = centerInside ? (k + 1) % 4 : (k + 3) % 4;
+        else
+        {
+            e = (k + 1) % 4;
+            while(!(!in[e] && in[(e + 1) % 4]))//Next edge entering the region
+                e = (e + 1) % 4;
+        }
+        zeroSetSegment segment;
+        segment.from = keys[k];
+        segment.to = keys[e];
+        segment.a = points[k];
+        segment.b = points[e];
+        out.segments.push_back(segment);
+    }
+}
+
+/*Function to visit a cell: dropped if f cannot be 0 in it, contoured if it is a leaf, split into 4 otherwise. The 5 new
+lattice points of the split are evaluated in one call. Large cells are split into tasks of the active pool*/
+inline void zeroSetVisit(const zeroSetGrid &grid, const zeroSetCell &cell, zeroSetOutput &out)
+{
+    out.cells++;
+    bool in = zeroSetInside(cell.f[0]);
+    bool signChange = zeroSetInside(cell.f[1]) != in || zeroSetInside(cell.f[2]) != in || zeroSetInside(cell.f[3]) != in;
+    if(!signChange && grid.bounded && !boxMayHoldZero(grid.tree, zeroSetX(grid, cell.i), zeroSetX(grid, cell.i + cell.size),
+                                                       zeroSetY(grid, cell.j), zeroSetY(grid, cell.j + cell.size)))
+        return;
+    if(cell.size == 1)
+    {
+        zeroSetLeaf(grid, cell, out);
+        return;
+    }
+    long long i = cell.i, j = cell.j, s = cell.size, h = s / 2;
+    double xs[5] = {zeroSetX(grid, i + h), zeroSetX(grid, i + s), zeroSetX(grid, i + h), zeroSetX(grid, i), zeroSetX(grid, i + h)};
+    double ys[5] = {zeroSetY(grid, j), zeroSetY(grid, j + h), zeroSetY(grid, j + s), zeroSetY(grid, j + h), zeroSetY(grid, j + h)};
+    double f[5];//Bottom, right, top and left midpoints, center
+    (*grid.evaluate)(xs, ys, f, 5);
+    zeroSetCell children[4];
+    long long ci[4] = {i, i + h, i + h, i}, cj[4] = {j, j, j + h, j + h};
+    double corners[4][4] = {{cell.f[0], f[0], f[4], f[3]}, {f[0], cell.f[1], f[1], f[4]},
+                            {f[4], f[1], cell.f[2], f[2]}, {f[3], f[4], f[2], cell.f[3]}};
+    int k;
+    for(k = 0; k < 4; k++)
+    {
+        children[k].i = ci[k];
+        children[k].j = cj[k];
+        children[k].size = h;
+        std::copy(corners[k], corners[k] + 4, children[k].f);
+    }
+    workStealingPool *pool = activePool();
+    if(pool == NULL || s < ZEROSET_TASK_SIZE)
+    {
+        for(k = 0; k < 4; k++)
+            zeroSetVisit(grid, children[k], out);
+        return;
+    }
+    zeroSetOutput outputs[4];
+    taskGroup group;
+    for(k = 0; k < 4; k++)
+    {
+        const zeroSetCell *child = &children[k];
+        zeroSetOutput *output = &outputs[k];
+        poolSpawn(*pool, group, [&grid, child, output]() { zeroSetVisit(grid, *child, *output); });
+    }
+    poolWait(*pool, group);
+    for(k = 0; k < 4; k++)
+    {
+        out.segments.insert(out.segments.end(), outputs[k].segments.begin(), outputs[k].segments.end());
+        out.cells += outputs[k].cells;
+    }
+}
+
+/*Function to obtain the position of a crossing along the edge of the box, counterclockwise from the lower left corner:
+bottom, right, top, then left edge. Returns -1 if the edge with key lies inside the box*/
+inline double zeroSetBorder(const zeroSetGrid &grid, uint64_t key, const zeroSetPoint &p)
+{
+    long long n = grid.n;
+    uint64_t index = key / 2;
+    long long i = (long long)(index % (uint64_t)(n + 1)), j = (long long)(index / (uint64_t)(n + 1));
+    double width = zeroSetX(grid, n) - grid.xmin, height = zeroSetY(grid, n) - grid.ymin;
+    if(key % 2 == 0)//Horizontal edge
+    {
+        if(j == 0)
+            return p.x - grid.xmin;
+        if(j == n)
+            return width + height + (zeroSetX(grid, n) - p.x);
+    }
+    else
+    {
+        if(i == n)
+            return width + (p.y - grid.ymin);
+        if(i == 0)
+            return 2 * width + height + (zeroSetY(grid, n) - p.y);
+    }
+    return -1.0;
+}
+
+/*Function to link the segments of every leaf into closed polygons. Segments meet at the edges they cross: the segment
+that ends on an edge is followed by the one that starts there. Chains that end at the edge of the box are continued
+along it, counterclockwise(the region is on the left) to the start of the next chain, through the box corners on the
+way. If nothing reaches the edge of the box and corner(f at the lower left corner of the box) is inside, the whole edge
+of the box is a polygon around everything else*/
+inline void zeroSetLink(const zeroSetGrid &grid, const std::vector<zeroSetSegment> &segments, double corner, zeroSetResult &result)
+{
+    std::unordered_map<uint64_t, size_t> byStart, byEnd;
+    size_t s;
+    for(s = 0; s < segments.size(); s++)
+    {
+        byStart[segments[s].from] = s;
+        byEnd[segments[s].to] = s;
+    }
+    std::vector<char> used(segments.size(), 0);
+    std::vector< std::vector<zeroSetPoint> > chains;//Open chains, from a start no segment ends at
+    std::vector<double> chainStart, chainEnd;//Border positions of their ends, -1 inside the box
+    for(s = 0; s < segments.size(); s++)
+    {
+        if(byEnd.count(segments[s].from))
+            continue;
+        std::vector<zeroSetPoint> chain(1, segments[s].a);
+        size_t c = s;
+        while(true)
+        {
+            used[c] = 1;
+            chain.push_back(segments[c].b);
+            std::unordered_map<uint64_t, size_t>::iterator it = byStart.find(segments[c].to);
+            if(it == byStart.end() || used[it->second])
+                break;
+            c = it->second;
+        }
+        chainStart.push_back(zeroSetBorder(grid, segments[s].from, segments[s].a));
+        chainEnd.push_back(zeroSetBorder(grid, segments[c].to, segments[c].b));
+        chains.push_back(chain);
+    }
+    for(s = 0; s < segments.size(); s++)//Everything left is a closed loop
+    {
+        if(used[s])
+            continue;
+        std::vector<zeroSetPoint> polygon;
+        size_t c = s;
+        while(!used[c])
+        {
+            used[c] = 1;
+            polygon.push_back(segments[c].a);
+            std::unordered_map<uint64_t, size_t>::iterator it = byStart.find(segments[c].to);
+            if(it == byStart.end())
+                break;
+            c = it->second;
+        }
+        result.polygons.push_back(polygon);
+    }
+    double xmax = zeroSetX(grid, grid.n), ymax = zeroSetY(grid, grid.n);
+    double width = xmax - grid.xmin, height = ymax - grid.ymin, perimeter = 2 * (width + height);
+    zeroSetPoint corners[4] = {{xmax, grid.ymin}, {xmax, ymax}, {grid.xmin, ymax}, {grid.xmin, grid.ymin}};
+    double cornerAt[4] = {width, width + height, 2 * width + height, perimeter};//Border positions of the corners
+    bool touches = false;
+    std::vector<char> done(chains.size(), 0);
+    size_t c;
+    for(c = 0; c < chains.size(); c++)
+    {
+        if(done[c])
+            continue;
+        if(chainStart[c] < 0 || chainEnd[c] < 0)//Broken off inside the box(f undefined nearby), closed straight
+        {
+            done[c] = 1;
+            result.polygons.push_back(chains[c]);
+            continue;
+        }
+        touches = true;
+        std::vector<zeroSetPoint> polygon;
+        size_t k = c;
+        while(!done[k])
+        {
+            done[k] = 1;
+            polygon.insert(polygon.end(), chains[k].begin(), chains[k].end());
+            size_t next = chains.size(), m;
+            double best = perimeter;//Counterclockwise distance from the end of chain k to the start of chain next
+            for(m = 0; m < chains.size(); m++)
+            {
+                if(chainStart[m] < 0 || chainEnd[m] < 0)
+                    continue;
+                double d = fmod(chainStart[m] - chainEnd[k] + perimeter, perimeter);
+                if(d < best || next == chains.size())
+                {
+                    best = d;
+                    next = m;
+                }
+            }
+            std::vector< std::pair<double, int> > passed;//Corners between the two, by distance
+            int q;
+            for(q = 0; q < 4; q++)
+            {
+                double d = fmod(cornerAt[q] - chainEnd[k] + perimeter, perimeter);
+                if(d > 0 && d < best)
+                    passed.push_back(std::make_pair(d, q));
+            }
+            std::sort(passed.begin(), passed.end());
+            for(q = 0; q < (int)passed.size(); q++)
+                polygon.push_back(corners[passed[q].second]);
+            k = next;
+        }
+        result.polygons.push_back(polygon);
+    }
+    if(!touches && zeroSetInside(corner))
+    {
+        std::vector<zeroSetPoint> box(corners + 3, corners + 4);
+        box.insert(box.end(), corners, corners + 3);
+        result.polygons.push_back(box);
+    }
+}
+
+/*Function to find the boundary f(x,y) = 0 in the box [xmin,xmax]x[ymin,ymax] with leaves of at most cellSize on each
+side, evaluating f with evaluate. Fills result with the polygons around f(x,y) < 0 and their area. Returns false if the
+box or cell size is not usable*/
+inline bool zeroSetExtract(const std::string &function, const zeroSetEvaluator &evaluate, double xmin, double xmax, double ymin,
+                           double ymax, double cellSize, zeroSetResult &result)
+{
+    INSTRUMENT_STAGE(TRACE);
+    result.polygons.clear();
+    result.area = 0.0;
+    result.cells = 0;
+    result.points = 0;
+    if(!(xmax > xmin && ymax > ymin && cellSize > 0.0))
+        return false;
+    zeroSetGrid grid;
+    int depth = (int)ceil(log2(std::max(xmax - xmin, ymax - ymin) / cellSize));
+    depth = std::min(std::max(depth, 0), ZEROSET_MAX_DEPTH);
+    grid.n = 1LL << depth;
+    grid.xmin = xmin;
+    grid.ymin = ymin;
+    grid.dx = (xmax - xmin) / grid.n;
+    grid.dy = (ymax - ymin) / grid.n;
+    grid.bounded = parseTree(function, grid.tree);
+    grid.evaluate = &evaluate;
+    zeroSetCell root;
+    root.i = root.j = 0;
+    root.size = grid.n;
+    double xs[4] = {zeroSetX(grid, 0), zeroSetX(grid, grid.n), zeroSetX(grid, grid.n), zeroSetX(grid, 0)};
+    double ys[4] = {zeroSetY(grid, 0), zeroSetY(grid, 0), zeroSetY(grid, grid.n), zeroSetY(grid, grid.n)};
+    evaluate(xs, ys, root.f, 4);
+    zeroSetOutput out;
+    zeroSetVisit(grid, root, out);
+    INSTRUMENT_COUNT(STEPS, out.cells);
+    zeroSetLink(grid, out.segments, root.f[0], result);
+    result.cells = out.cells;
+    size_t k;
+    for(k = 0; k < result.polygons.size(); k++)
+    {
+        const std::vector<zeroSetPoint> &polygon = result.polygons[k];
+        if(polygon.empty())
+            continue;
+        result.area += signedPolygonArea2(&polygon[0].x, &polygon[0].y, polygon.size(), 2) / 2;
+        result.points += polygon.size();
+    }
+    return true;
+}
+
+#endif